@@ -0,0 +1,137 @@
+/*  =========================================================================
+    Benchmark of the particle batch update kernels (see particles.h)
+
+    Runs every kernel this CPU supports over the same particles, prints how
+    long each takes per particle and checks they give the same positions as
+    the scalar loop. Also checks that the box around the particles stays 
+    tight when stepping with a fixed clock. Doesn't open a window.
+    =========================================================================
+    LICENSE: zlib
+    Copyright (C) 2021 Vlad Adrian (@Demizdor - https://github.com/Demizdor)
+    =========================================================================
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define LIB_RAY_PARTICLES_IMPL
+#include "particles.h"
+
+#define PARTICLES 20000
+#define ROUNDS 2000
+
+// Step an emitter far from the origin with and without a fixed clock and check both boxes around its particles are the same 
+// (interpolating only needs the positions before the last step, the box shouldn't grow with every step)
+static bool CheckFixedStepBounds(void)
+{
+    Color color = WHITE;
+    Emitter e[2] = {0};
+    ParticlesClock clock = ParticlesClockCreate(60);
+    Rectangle bounds[2];
+    for(int k=0; k<2; ++k) 
+    {
+        if(!EmitterAllocateParticles(&e[k], 1000)) return false;
+        e[k].position = (Vector2){1000.0f, 1000.0f};
+        e[k].life = 4.0f;
+        e[k].flags = EMITTER_FLAG_LOOP;
+        e[k].config.emission = 2000;
+        e[k].config.age.min = e[k].config.age.max = 2.0f;
+        e[k].config.speed.min = e[k].config.speed.max = 150.0f;
+        e[k].config.size.min = e[k].config.size.max = 1.0f;
+        e[k].config.scale.start = e[k].config.scale.end = 1.0f;
+        e[k].config.angle.max = 360.0f;
+        e[k].config.gradient.colors = &color;
+        e[k].config.gradient.count = 1;
+        e[k].config.easing = &EaseLinearNone;
+        
+        RngState rng;
+        RngSeed(&rng, 1234);
+        for(int frame=0; frame<240; ++frame) {
+            if(k == 0) EmitterUpdateDt(&e[k], clock.step, &rng);
+            else {
+                ParticlesClockAdvance(&clock, clock.step); // exactly one step per frame (the same ones as above)
+                EmitterUpdateFixed(&e[k], &clock, &rng);
+            }
+        }
+        bounds[k] = EmitterGetBounds(&e[k]);
+    }
+    
+    // the fixed step box also holds the positions before the last step so it can only be a bit bigger
+    const float slack = 150.0f*clock.step + 1.0f;
+    const bool tight = e[0].particles.count > 0 && e[0].particles.count == e[1].particles.count && 
+        fabsf(bounds[0].x - bounds[1].x) <= slack && fabsf(bounds[0].y - bounds[1].y) <= slack && 
+        fabsf(bounds[0].width - bounds[1].width) <= 2*slack && fabsf(bounds[0].height - bounds[1].height) <= 2*slack;
+    printf("bounds   %s (%.0f %.0f %.0f %.0f, fixed step %.0f %.0f %.0f %.0f)\n", tight ? "ok" : "NOT TIGHT", 
+        bounds[0].x, bounds[0].y, bounds[0].width, bounds[0].height, bounds[1].x, bounds[1].y, bounds[1].width, bounds[1].height);
+    
+    for(int k=0; k<2; ++k) EmitterFreeParticles(&e[k]);
+    return tight;
+}
+
+#if defined(PARTICLES_COMPACT)
+int main(void)
+{
+    printf("the compact layout has no batch kernels\n");
+    return !CheckFixedStepBounds();
+}
+#else
+// Give the particles of `e` the same known state
+static void ResetParticles(Emitter* e)
+{
+    for(int i=0; i<PARTICLES; ++i) {
+        e->particles.position[i] = (Vector2){0.0f, 0.0f};
+        e->particles.direction[i] = Vector2Normalize((Vector2){(float)(i%13) - 6.0f, (float)(i%7) - 3.5f});
+        e->particles.time[i] = 0.0f;
+        e->particles.life[i] = 5.0f + i%7;
+        e->particles.speed[i] = 20.0f + i%50;
+    }
+    e->particles.count = PARTICLES;
+}
+
+// Run `kernel` over all the particles ROUNDS times. Returns nanoseconds per particle
+static double RunKernel(Emitter* e, ParticleBatchKernel kernel, const ParticleBatch* b)
+{
+    ResetParticles(e);
+    const clock_t start = clock();
+    for(int r=0; r<ROUNDS; ++r) kernel(e, 0, PARTICLES, b);
+    return 1e9*(double)(clock() - start)/CLOCKS_PER_SEC/((double)ROUNDS*PARTICLES);
+}
+
+int main(void)
+{
+    Emitter e = {0};
+    if(!EmitterAllocateParticles(&e, PARTICLES)) return 1;
+    static Vector2 expected[PARTICLES];
+
+    const ParticleBatch b = { 1.0f/60.0f, 10.0f, -15.0f, {0.1f, 0.2f} };
+    const struct { const char* name; ParticleBatchKernel kernel; bool supported; } kernels[] = {
+        { "scalar", &ParticlesUpdateBatchScalar, true },
+    #if defined(PARTICLES_SIMD_X86)
+        { "sse2", &ParticlesUpdateBatchSSE2, __builtin_cpu_supports("sse2") },
+        { "avx2", &ParticlesUpdateBatchAVX2, __builtin_cpu_supports("avx2") },
+    #endif
+    };
+
+    int failed = 0;
+    for(int k=0; k<(int)(sizeof(kernels)/sizeof(kernels[0])); ++k)
+    {
+        if(!kernels[k].supported) {
+            printf("%-8s not supported\n", kernels[k].name);
+            continue;
+        }
+        const double ns = RunKernel(&e, kernels[k].kernel, &b);
+
+        // the scalar loop gives the reference positions
+        bool same = true;
+        if(k == 0) memcpy(expected, e.particles.position, sizeof(expected));
+        else same = memcmp(expected, e.particles.position, sizeof(expected)) == 0;
+        failed += !same;
+        printf("%-8s %.3f ns/particle %s\n", kernels[k].name, ns, same ? "" : "(DIFFERENT RESULTS)");
+    }
+
+    EmitterFreeParticles(&e);
+    failed += !CheckFixedStepBounds();
+    return failed;
+}
+#endif
@@ -15,6 +15,11 @@
     =========================================================================
 */
 
+#if defined(EDITOR_HUGE_PAGES) && defined(__linux__)
+    #define _DEFAULT_SOURCE     // MAP_ANONYMOUS and madvise() are hidden with -std=c99
+    #include <sys/mman.h>
+#endif
+
 #include <stdio.h>
 #include <string.h>
 
@@ -29,6 +34,468 @@
 static void UpdateEditor();
 static void DrawEditor();
 
+// ---------------------------------------------------------------------------------------
+// Arena
+// ---------------------------------------------------------------------------------------
+// Header at the start of every chunk (the blocks start right after it)
+typedef struct ArenaChunk {
+    struct ArenaChunk* next;
+    void* raw;              // pointer to free() (NULL when the chunk was mapped)
+    size_t size;            // bytes available for blocks
+    size_t used;            // bytes carved so far
+} ArenaChunk;
+
+#define ARENA_HEADER ((sizeof(ArenaChunk) + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1))
+#define ARENA_HUGE_PAGE ((size_t)2*1024*1024)
+
+// Get the size class of a `size` bytes block and its real size (a multiple of ARENA_ALIGNMENT that wastes at most 25%)
+static int ArenaClass(size_t size, size_t* class_size) 
+{
+    if(size <= 4*ARENA_ALIGNMENT) {
+        const int c = (size > 0) ? (int)((size + ARENA_ALIGNMENT - 1)/ARENA_ALIGNMENT) - 1 : 0;
+        *class_size = (c+1)*ARENA_ALIGNMENT;
+        return c;
+    }
+    size_t base = 4*ARENA_ALIGNMENT;
+    for(int c=4; c<ARENA_CLASSES; c+=4, base*=2) {
+        for(int k=1; k<=4; ++k) {
+            if(size <= base + base/4*k) {
+                *class_size = base + base/4*k;
+                return c + k - 1;
+            }
+        }
+    }
+    return -1;
+}
+
+// Map a chunk with room for `size` bytes of blocks and put it at the start of `list`
+static ArenaChunk* ArenaMapChunk(SArena* arena, size_t size, ArenaChunk** list) 
+{
+    size_t bytes = ARENA_HEADER + size;
+#if defined(EDITOR_HUGE_PAGES) && defined(__linux__)
+    // only whole huge pages on a huge page boundary can be backed by a transparent huge page, so map one more page than 
+    // needed and unmap what is left before and after the aligned range
+    bytes = (bytes + ARENA_HUGE_PAGE - 1) & ~(ARENA_HUGE_PAGE - 1);
+    unsigned char* memory = mmap(NULL, bytes + ARENA_HUGE_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(memory == MAP_FAILED) return NULL;
+    unsigned char* aligned = (unsigned char*)(((uintptr_t)memory + ARENA_HUGE_PAGE - 1) & ~(uintptr_t)(ARENA_HUGE_PAGE - 1));
+    if(aligned > memory) munmap(memory, aligned - memory);
+    munmap(aligned + bytes, memory + ARENA_HUGE_PAGE - aligned);
+    madvise(aligned, bytes, MADV_HUGEPAGE); // just a hint, the kernel can still use normal pages
+    ArenaChunk* chunk = (ArenaChunk*)aligned;
+    chunk->raw = NULL;
+    size = bytes - ARENA_HEADER; // the rest of the last page can hold blocks too
+    arena->total += bytes;
+#else
+    void* raw = calloc(1, bytes + ARENA_ALIGNMENT);
+    if(raw == NULL) return NULL;
+    ArenaChunk* chunk = (ArenaChunk*)(((uintptr_t)raw + ARENA_ALIGNMENT - 1) & ~(uintptr_t)(ARENA_ALIGNMENT - 1));
+    chunk->raw = raw;
+    arena->total += bytes + ARENA_ALIGNMENT;
+#endif
+    chunk->size = size;
+    chunk->used = 0;
+    chunk->next = *list;
+    *list = chunk;
+    return chunk;
+}
+
+void* ArenaAlloc(SArena* arena, size_t size) 
+{
+    size_t bytes = 0;
+    const int c = ArenaClass(size, &bytes);
+    if(c < 0) return NULL;
+    
+    void* ptr = arena->free[c];
+    if(ptr != NULL) 
+    {
+        // reuse a freed block
+        arena->free[c] = *(void**)ptr;
+        memset(ptr, 0, bytes);
+    }
+    else 
+    {
+        // carve a new block (the rest of a full chunk is left unused). Blocks too big for a chunk get their own one, kept 
+        // out of the carve list so the current chunk can still be carved from
+        ArenaChunk* chunk = arena->chunks;
+        if(bytes > ARENA_CHUNK_SIZE - ARENA_HEADER) chunk = ArenaMapChunk(arena, bytes, &arena->large);
+        else if(chunk == NULL || chunk->size - chunk->used < bytes) chunk = ArenaMapChunk(arena, ARENA_CHUNK_SIZE - ARENA_HEADER, &arena->chunks);
+        if(chunk == NULL) return NULL;
+        ptr = (unsigned char*)chunk + ARENA_HEADER + chunk->used;
+        chunk->used += bytes;
+    }
+    arena->used += bytes;
+    return ptr;
+}
+
+void ArenaFree(SArena* arena, void* ptr, size_t size) 
+{
+    size_t bytes = 0;
+    const int c = ArenaClass(size, &bytes);
+    if(ptr == NULL || c < 0) return;
+    
+    *(void**)ptr = arena->free[c];
+    arena->free[c] = ptr;
+    arena->used -= bytes;
+}
+
+static void ArenaUnmapChunks(ArenaChunk* chunk) 
+{
+    while(chunk != NULL) 
+    {
+        ArenaChunk* next = chunk->next;
+    #if defined(EDITOR_HUGE_PAGES) && defined(__linux__)
+        munmap(chunk, ARENA_HEADER + chunk->size);
+    #else
+        free(chunk->raw);
+    #endif
+        chunk = next;
+    }
+}
+
+void ArenaRelease(SArena* arena) 
+{
+    ArenaUnmapChunks(arena->chunks);
+    ArenaUnmapChunks(arena->large);
+    *arena = (SArena){0};
+}
+
+// An emitter with its gradient and forces stored right after it (so they come from the same block)
+typedef struct {
+    Emitter emitter;
+    Color colors[MAX_COLORS];
+    Force forces[MAX_FORCES];
+} EditorEmitter;
+
+Emitter* EditorAllocateEmitter(int max) 
+{
+    EditorEmitter* slot = ArenaAlloc(&Editor.arena, sizeof(EditorEmitter));
+    void* particles = ArenaAlloc(&Editor.arena, ParticlesMemorySize(max));
+    if(slot == NULL || particles == NULL) TraceLog(LOG_FATAL, "EMITTER: Failed to allocate memory");
+    
+    slot->emitter.config.gradient.colors = slot->colors;
+    slot->emitter.config.forces.data = slot->forces;
+    EmitterSetParticleMemory(&slot->emitter, particles, max);
+    return &slot->emitter;
+}
+
+void EditorFitEmitter(Emitter* e) 
+{
+    const int max = EmitterWantedCapacity(e);
+    if(max == e->particles.max) return;
+    
+    void* memory = ArenaAlloc(&Editor.arena, ParticlesMemorySize(max));
+    if(memory == NULL) {
+        TraceLog(LOG_WARNING, "PARTICLES: Failed to resize to %i particles", max);
+        return;
+    }
+    void* old = e->particles.data;
+    const int old_max = e->particles.max;
+    EmitterMoveParticles(e, memory, max);
+    ArenaFree(&Editor.arena, old, ParticlesMemorySize(old_max));
+}
+
+void EditorFreeEmitter(Emitter* e) 
+{
+    EditorReleaseTexture(e->config.atlas.texture);
+    EmitterFreeExtraArrays(e); // these come from the heap, not the arena
+    ArenaFree(&Editor.arena, e->particles.data, ParticlesMemorySize(e->particles.max));
+    ArenaFree(&Editor.arena, e, sizeof(EditorEmitter));
+}
+
+// ---------------------------------------------------------------------------------------
+// Textures
+// ---------------------------------------------------------------------------------------
+#define TEXTURE_PATH_SEED 0xcbf29ce484222325ULL         // FNV-1a offset basis
+#define TEXTURE_CONTENT_SEED 0x84222325cbf29ce4ULL      // another basis so a path hash and a content hash don't mix
+#define TEXTURE_ID_KEY(id) (0x9e3779b97f4a7c15ULL*((uint64_t)(id) + 1))
+
+// FNV-1a hash of `size` bytes
+static uint64_t TextureHash(const void* data, size_t size, uint64_t seed) 
+{
+    const unsigned char* bytes = data;
+    uint64_t hash = seed;
+    for(size_t i=0; i<size; ++i) hash = (hash ^ bytes[i])*0x100000001b3ULL;
+    return hash;
+}
+
+static inline bool TextureKeyAlive(const STextureKey* k) 
+{
+    return k->generation != 0 && k->generation == Editor.textures.entries[k->entry].generation;
+}
+
+// Get the bucket of a key (NULL when it isn't in the map)
+static STextureKey* TextureFindKey(uint64_t key) 
+{
+    STextureRegistry* r = &Editor.textures;
+    if(r->map_capacity == 0) return NULL;
+    const int mask = r->map_capacity - 1;
+    for(int i=(int)(key & mask); r->map[i].generation != 0; i=(i+1) & mask) {
+        if(r->map[i].key == key && TextureKeyAlive(&r->map[i])) return &r->map[i];
+    }
+    return NULL;
+}
+
+// Get the entry of a key (-1 when there is none)
+static int TextureFind(uint64_t key) 
+{
+    const STextureKey* k = TextureFindKey(key);
+    return (k != NULL) ? k->entry : -1;
+}
+
+// Put a key in the first empty or stale bucket (the key must not be in the map already)
+static void TexturePlaceKey(STextureKey key) 
+{
+    STextureRegistry* r = &Editor.textures;
+    const int mask = r->map_capacity - 1;
+    int i = (int)(key.key & mask);
+    while(TextureKeyAlive(&r->map[i])) i = (i+1) & mask;
+    if(r->map[i].generation == 0) r->map_used += 1;
+    r->map[i] = key;
+}
+
+static void TextureAddKey(uint64_t key, int entry, long mod_time) 
+{
+    STextureRegistry* r = &Editor.textures;
+    if(2*(r->map_used + 1) > r->map_capacity) 
+    {
+        // rebuild the map with room for twice the alive keys (this drops the stale ones)
+        int alive = 0;
+        for(int i=0; i<r->map_capacity; ++i) alive += TextureKeyAlive(&r->map[i]);
+        int n = 64;
+        while(n < 4*(alive + 1)) n *= 2;
+        
+        STextureKey* old = r->map;
+        const int old_capacity = r->map_capacity;
+        r->map = ArenaAlloc(&Editor.arena, n*sizeof(STextureKey));
+        if(r->map == NULL) TraceLog(LOG_FATAL, "TEXTURE: Failed to allocate memory");
+        r->map_capacity = n;
+        r->map_used = 0;
+        for(int i=0; i<old_capacity; ++i) {
+            if(TextureKeyAlive(&old[i])) TexturePlaceKey(old[i]);
+        }
+        ArenaFree(&Editor.arena, old, old_capacity*sizeof(STextureKey));
+    }
+    TexturePlaceKey((STextureKey){ key, entry, r->entries[entry].generation, mod_time });
+}
+
+static int TextureNewEntry(Texture texture) 
+{
+    STextureRegistry* r = &Editor.textures;
+    int entry = 0;
+    if(r->free_count > 0) entry = r->free[--r->free_count];
+    else 
+    {
+        if(r->count == r->capacity) 
+        {
+            const int n = (r->capacity > 0) ? 2*r->capacity : 16;
+            STexture* entries = ArenaAlloc(&Editor.arena, n*sizeof(STexture));
+            int* free = ArenaAlloc(&Editor.arena, n*sizeof(int));
+            if(entries == NULL || free == NULL) TraceLog(LOG_FATAL, "TEXTURE: Failed to allocate memory");
+            if(r->entries != NULL) memcpy(entries, r->entries, r->capacity*sizeof(STexture));
+            ArenaFree(&Editor.arena, r->entries, r->capacity*sizeof(STexture));
+            ArenaFree(&Editor.arena, r->free, r->capacity*sizeof(int));
+            r->entries = entries;
+            r->free = free; // the stack is empty here
+            r->capacity = n;
+        }
+        entry = r->count++;
+        r->entries[entry].generation = 1; // 0 marks the empty buckets
+    }
+    r->entries[entry].texture = texture;
+    r->entries[entry].refs = 0;
+    return entry;
+}
+
+// Get a reference to the texture of a file, it is only loaded when no other file with the same path or contents is 
+// (a file changed since it was loaded is read again)
+Texture EditorAcquireTexture(const char* path) 
+{
+    STextureRegistry* r = &Editor.textures;
+    const uint64_t path_key = TextureHash(path, strlen(path), TEXTURE_PATH_SEED);
+    const long mod_time = GetFileModTime(path);
+    const STextureKey* k = TextureFindKey(path_key);
+    int entry = (k != NULL && k->mod_time == mod_time) ? k->entry : -1;
+    if(entry == -1) 
+    {
+        // hash the file contents to find the same image loaded from another path
+        const char* ext = GetFileExtension(path);
+        unsigned int size = 0;
+        unsigned char* data = (ext != NULL) ? LoadFileData(path, &size) : NULL;
+        if(data == NULL) return (Texture){0};
+        
+        const uint64_t content_key = TextureHash(data, size, TEXTURE_CONTENT_SEED);
+        entry = TextureFind(content_key);
+        if(entry == -1) 
+        {
+            Image image = LoadImageFromMemory(TextToLower(ext), data, size);
+            Texture texture = LoadTextureFromImage(image);
+            UnloadImage(image);
+            if(texture.id == 0) {
+                UnloadFileData(data);
+                return (Texture){0};
+            }
+            entry = TextureNewEntry(texture);
+            TextureAddKey(content_key, entry, 0);
+            TextureAddKey(TEXTURE_ID_KEY(texture.id), entry, 0);
+        }
+        UnloadFileData(data);
+        
+        // point the path to what the file holds now (looked up again since adding keys can rebuild the map)
+        STextureKey* old = TextureFindKey(path_key);
+        if(old != NULL) *old = (STextureKey){ path_key, entry, r->entries[entry].generation, mod_time };
+        else TextureAddKey(path_key, entry, mod_time);
+    }
+    r->entries[entry].refs += 1;
+    return r->entries[entry].texture;
+}
+
+// Get another reference to a texture that was acquired before (e.g. when copying an emitter)
+Texture EditorRetainTexture(Texture texture) 
+{
+    const int entry = (texture.id > 0) ? TextureFind(TEXTURE_ID_KEY(texture.id)) : -1;
+    if(entry != -1) Editor.textures.entries[entry].refs += 1;
+    return texture;
+}
+
+// Drop a reference to a texture, unloading it when nobody else holds one
+void EditorReleaseTexture(Texture texture) 
+{
+    STextureRegistry* r = &Editor.textures;
+    const int entry = (texture.id > 0) ? TextureFind(TEXTURE_ID_KEY(texture.id)) : -1;
+    if(entry == -1 || --r->entries[entry].refs > 0) return;
+    
+    UnloadTexture(r->entries[entry].texture);
+    r->entries[entry].texture = (Texture){0};
+    r->entries[entry].generation += 1; // all of its keys go stale
+    r->free[r->free_count++] = entry;
+}
+
+// Hash of the textures and atlas pages of the emitters (in draw order)
+static unsigned int EditorAtlasHash(void) 
+{
+    unsigned int hash = 2166136261u;
+    if(!Editor.options.pack_atlas) return hash;
+    for(int i=0; i<Editor.emitter_count; ++i) {
+        hash = (hash ^ Editor.emitters[i]->config.atlas.texture.id)*16777619u;
+        hash = (hash ^ Editor.emitters[i]->config.atlas.page.id)*16777619u; // a new or pasted emitter has no page yet
+    }
+    return hash;
+}
+
+// Pack the emitter textures in atlas pages again when they changed (or unpack them when the option is off)
+static void EditorSyncAtlas(void) 
+{
+    if(EditorAtlasHash() == Editor.atlas.hash) return;
+    
+    ParticlesUnpackAtlas(Editor.emitters, Editor.emitter_count, Editor.atlas.pages, Editor.atlas.count);
+    Editor.atlas.count = 0;
+    if(Editor.options.pack_atlas) 
+        Editor.atlas.count = ParticlesPackAtlas(Editor.emitters, Editor.emitter_count, ATLAS_PAGE_SIZE, Editor.atlas.pages, ATLAS_MAX_PAGES);
+    Editor.atlas.hash = EditorAtlasHash();
+}
+
+// ---------------------------------------------------------------------------------------
+// Emitter pool
+// ---------------------------------------------------------------------------------------
+// Make room in the pool for at least `capacity` emitters (the arrays double so inserting stays O(1) on average)
+static void EditorReservePool(int capacity) 
+{
+    if(capacity <= Editor.emitter_capacity) return;
+    int n = (Editor.emitter_capacity > 0) ? 2*Editor.emitter_capacity : 8;
+    while(n < capacity) n *= 2;
+    
+    #define POOL_GROW_ARRAY(A) do { \
+        void* a = ArenaAlloc(&Editor.arena, n*sizeof(*(A))); \
+        if(a == NULL) TraceLog(LOG_FATAL, "EMITTER: Failed to allocate memory"); \
+        if((A) != NULL) memcpy(a, (A), Editor.emitter_capacity*sizeof(*(A))); \
+        ArenaFree(&Editor.arena, (A), Editor.emitter_capacity*sizeof(*(A))); \
+        (A) = a; \
+    } while(0)
+    POOL_GROW_ARRAY(Editor.emitters);
+    POOL_GROW_ARRAY(Editor.emitter_id);
+    POOL_GROW_ARRAY(Editor.slots.dense);
+    POOL_GROW_ARRAY(Editor.slots.generation);
+    POOL_GROW_ARRAY(Editor.slots.free);
+    #undef POOL_GROW_ARRAY
+    Editor.emitter_capacity = n;
+}
+
+EmitterHandle EditorInsertEmitter(Emitter* e) 
+{
+    EditorReservePool(Editor.emitter_count + 1);
+    
+    // reuse a free slot before making a new one
+    int slot = 0;
+    if(Editor.slots.free_count > 0) slot = Editor.slots.free[--Editor.slots.free_count];
+    else {
+        slot = Editor.slots.count++;
+        Editor.slots.generation[slot] += 1; // starts at 1 so a zeroed handle is never valid
+    }
+    
+    // new emitters are drawn on top of the others
+    const int index = Editor.emitter_count++;
+    Editor.emitters[index] = e;
+    Editor.emitter_id[index] = slot;
+    Editor.slots.dense[slot] = index;
+    return (EmitterHandle){ slot, Editor.slots.generation[slot] };
+}
+
+Emitter* EditorGetEmitter(EmitterHandle handle) 
+{
+    const int index = EditorGetEmitterIndex(handle);
+    return (index != -1) ? Editor.emitters[index] : NULL;
+}
+
+EmitterHandle EditorGetEmitterHandle(int index) 
+{
+    if(index < 0 || index >= Editor.emitter_count) return (EmitterHandle){0};
+    const int slot = Editor.emitter_id[index];
+    return (EmitterHandle){ slot, Editor.slots.generation[slot] };
+}
+
+// Get the position of an emitter in the draw order (-1 when the handle is stale)
+int EditorGetEmitterIndex(EmitterHandle handle) 
+{
+    if(handle.slot < 0 || handle.slot >= Editor.slots.count || Editor.slots.generation[handle.slot] != handle.generation) return -1;
+    return Editor.slots.dense[handle.slot];
+}
+
+// Remove the emitter from the pool and return it (the caller frees it). Returns NULL if the handle is stale
+Emitter* EditorTakeEmitter(EmitterHandle handle) 
+{
+    Emitter* e = EditorGetEmitter(handle);
+    if(e == NULL) return NULL;
+    
+    // close the gap so the draw order of the other emitters doesn't change
+    const int index = Editor.slots.dense[handle.slot];
+    const int after = Editor.emitter_count - index - 1;
+    memmove(&Editor.emitters[index], &Editor.emitters[index+1], after*sizeof(*Editor.emitters));
+    memmove(&Editor.emitter_id[index], &Editor.emitter_id[index+1], after*sizeof(*Editor.emitter_id));
+    Editor.emitter_count -= 1;
+    for(int i=index; i<Editor.emitter_count; ++i) Editor.slots.dense[Editor.emitter_id[i]] = i;
+    
+    Editor.slots.dense[handle.slot] = -1;
+    Editor.slots.generation[handle.slot] += 1;
+    Editor.slots.free[Editor.slots.free_count++] = handle.slot;
+    return e;
+}
+
+// Swap the emitters at index `a` and `b` in the draw order
+static void EditorSwapEmitters(int a, int b) 
+{
+    Emitter* tmp = Editor.emitters[a];
+    Editor.emitters[a] = Editor.emitters[b];
+    Editor.emitters[b] = tmp;
+    
+    //do the same with the ids
+    int tid = Editor.emitter_id[a];
+    Editor.emitter_id[a] = Editor.emitter_id[b];
+    Editor.emitter_id[b] = tid;
+    Editor.slots.dense[Editor.emitter_id[a]] = a;
+    Editor.slots.dense[Editor.emitter_id[b]] = b;
+}
+
 inline void SetDefaultOptions() 
 {
     // set default editor colors
@@ -38,6 +505,10 @@ inline void SetDefaultOptions()
     Editor.options.debug = RED;
     
     Editor.options.show_debug = Editor.options.show_grid = true;
+    Editor.options.fixed_step = false;
+    Editor.options.step_rate = 60;
+    Editor.options.budget_ms = 0;
+    Editor.options.pack_atlas = false;
 }
 
 void InitializeEditor() 
@@ -51,7 +522,7 @@ void InitializeEditor()
     // initialize the global editor variable
     Editor = (struct SEditor){0};
     Editor.camera.zoom = 1.0f;
-    Editor.active_emitter = -1;  // set no emitter active
+    Editor.active_emitter = (EmitterHandle){0};  // set no emitter active
     
     // setup default options
     SetDefaultOptions();
@@ -68,13 +539,19 @@ void InitializeEditor()
         Editor.options.fg = GetColor(LoadStorageValue(4));
         Editor.options.gridcolor = GetColor(LoadStorageValue(5));
         Editor.options.debug = GetColor(LoadStorageValue(6));
+        Editor.options.fixed_step = LoadStorageValue(8);
+        if(LoadStorageValue(9) > 0) Editor.options.step_rate = LoadStorageValue(9);
+        Editor.options.budget_ms = LoadStorageValue(10);
+        Editor.options.pack_atlas = LoadStorageValue(11);
     }
     SetTraceLogLevel(LOG_INFO);
     
-    // set default ids
-    for(int i=0; i<MAX_EMITTERS; ++i) {
-        Editor.emitter_id[i] = i;
-    }
+    Editor.budget = ParticlesBudgetCreate(Editor.options.budget_ms/1000.0f);
+    
+#if defined(PARTICLES_THREADS)
+    Editor.pool = ParticlesPoolCreate(0);
+    if(Editor.pool == NULL) TraceLog(LOG_WARNING, "Failed to start the update threads, updating on the main thread");
+#endif
     
 }
 
@@ -83,24 +560,34 @@ void DeallocateEmitters()
     // deallocate memory
     for(int i=0; i<Editor.emitter_count; ++i) 
     {
-        free(Editor.emitters[i]->particles.data);
-        free(Editor.emitters[i]->config.gradient.colors);
-        free(Editor.emitters[i]->config.forces.data);
-        free(Editor.emitters[i]);
-        Editor.statistics.total_mem -= sizeof(Emitter) + MAX_PARTICLES*sizeof(Particle) + MAX_COLORS*sizeof(Color) + MAX_FORCES*sizeof(Force);
+        EditorFreeEmitter(Editor.emitters[i]);
         Editor.emitters[i] = NULL;
     }
+    
+    // free every slot (bumping the generations so the old handles go stale)
+    for(int s=0; s<Editor.slots.count; ++s) {
+        if(Editor.slots.dense[s] != -1) Editor.slots.generation[s] += 1;
+        Editor.slots.dense[s] = -1;
+    }
+    Editor.slots.count = Editor.slots.free_count = 0;
+    Editor.emitter_count = 0;
 }
 
 void FinalizeEditor() 
 {
-    // unload textures
+    // unload textures (the emitter textures are released along with the emitters)
     UnloadTexture(Editor.placeholder);
-    if(Editor.clipboard != NULL) UnloadTexture(Editor.clipboard->config.atlas.texture);
+    ParticlesUnpackAtlas(Editor.emitters, Editor.emitter_count, Editor.atlas.pages, Editor.atlas.count);
+    
+#if defined(PARTICLES_THREADS)
+    ParticlesPoolDestroy(Editor.pool);
+#endif
     
     // deallocate emitters and clipboard
     DeallocateEmitters();
-    if(Editor.clipboard != NULL) free(Editor.clipboard);
+    if(Editor.clipboard != NULL) EditorFreeEmitter(Editor.clipboard);
+    ArenaRelease(&Editor.arena);
+    Editor.textures = (STextureRegistry){0};
     
     // save options
     SetTraceLogLevel(LOG_NONE);
@@ -112,6 +599,10 @@ void FinalizeEditor()
     SaveStorageValue(5, ColorToInt(Editor.options.gridcolor));
     SaveStorageValue(6, ColorToInt(Editor.options.debug));
     SaveStorageValue(7, 1); // when loading signals that the options were saved
+    SaveStorageValue(8, Editor.options.fixed_step);
+    SaveStorageValue(9, Editor.options.step_rate);
+    SaveStorageValue(10, Editor.options.budget_ms);
+    SaveStorageValue(11, Editor.options.pack_atlas);
     SetTraceLogLevel(LOG_INFO);
     
     // raylib finalize
@@ -120,6 +611,8 @@ void FinalizeEditor()
 
 void UpdateEditor() 
 {
+    Emitter* active = EditorGetEmitter(Editor.active_emitter); // NULL when no emitter is selected
+    
     // ---------------------------------------------------------------------------------------
     // Move camera with right mouse button and move the active emitter with the left
     // ---------------------------------------------------------------------------------------
@@ -132,72 +625,55 @@ void UpdateEditor()
     {
         Editor.camera.offset = Vector2Subtract(Editor.offset, Vector2Subtract(Editor.mouse, GetMousePosition()));
     }
-    else if(Editor.active_emitter != -1 && CanMoveEmitter())
+    else if(active != NULL && CanMoveEmitter())
     {
         if(IsMouseButtonPressed(MOUSE_LEFT_BUTTON)) {
             Editor.mouse = GetMousePosition();
-            Editor.offset = Editor.emitters[Editor.active_emitter]->position;
+            Editor.offset = active->position;
         } else if(IsMouseButtonDown(MOUSE_LEFT_BUTTON)) {
-            Editor.emitters[Editor.active_emitter]->position = Vector2Subtract(Editor.offset, Vector2Subtract(Editor.mouse, GetMousePosition()));
+            active->position = Vector2Subtract(Editor.offset, Vector2Subtract(Editor.mouse, GetMousePosition()));
         }
     }
     
     // ---------------------------------------------------------------------------------------
     // Handle Copy/Pasting of emitters
     // ---------------------------------------------------------------------------------------
-    if(Editor.active_emitter != -1 && CanMoveEmitter() && (IsKeyDown(KEY_RIGHT_CONTROL) || IsKeyDown(KEY_LEFT_CONTROL)) )
+    if(active != NULL && CanMoveEmitter() && (IsKeyDown(KEY_RIGHT_CONTROL) || IsKeyDown(KEY_LEFT_CONTROL)) )
     {
         if(IsKeyPressed(KEY_C)) 
         {
             if(Editor.clipboard != NULL) 
             {
                 // erase old clipboard content
-                memset(Editor.clipboard->particles.data, 0, MAX_PARTICLES*sizeof(Particle));
+                EmitterResetParticles(Editor.clipboard);
                 memset(Editor.clipboard->config.gradient.colors, 0, MAX_COLORS*sizeof(Color));
                 memset(Editor.clipboard->config.forces.data, 0, MAX_FORCES*sizeof(Force));
                 
-                // unload texture only if not in use
-                bool unload = true;
-                for(int i=0; i<Editor.emitter_count; ++i) 
-                {
-                    if( Editor.emitters[i]->config.atlas.texture.id == Editor.clipboard->config.atlas.texture.id) {
-                        unload = false; 
-                        break;
-                    }
-                }
-                
-                if(unload) UnloadTexture(Editor.clipboard->config.atlas.texture);
+                EditorReleaseTexture(Editor.clipboard->config.atlas.texture);
             }
             else 
             {
-                // allocate clipboard memory 
-                Editor.clipboard = calloc(1, sizeof*Editor.clipboard);
-                if(Editor.clipboard == NULL) TraceLog(LOG_FATAL, "CLIPBOARD: Failed to allocate memory");
-                
-                Editor.clipboard->particles.data = calloc(MAX_PARTICLES, sizeof(Particle));
-                if(Editor.clipboard->particles.data == NULL) TraceLog(LOG_FATAL, "CLIPBOARD: Failed to allocate memory");
-                
-                Editor.clipboard->config.gradient.colors = calloc(MAX_COLORS, sizeof(Color));
-                if(Editor.clipboard->config.gradient.colors == NULL) TraceLog(LOG_FATAL, "CLIPBOARD: Failed to allocate memory");
-                
-                Editor.clipboard->config.forces.data = calloc(MAX_FORCES, sizeof(Force));
-                if(Editor.clipboard->config.forces.data == NULL) TraceLog(LOG_FATAL, "CLIPBOARD: Failed to allocate memory");
+                // allocate clipboard memory (its particles are never updated)
+                Editor.clipboard = EditorAllocateEmitter(1);
             }
             
             // save clipboard pointers
-            Particle* particles = Editor.clipboard->particles.data;
+            Emitter backup = *Editor.clipboard;
             Color* colors = Editor.clipboard->config.gradient.colors;
             Force* forces = Editor.clipboard->config.forces.data;
             
             // overwrite clipboard
-            *Editor.clipboard = *Editor.emitters[Editor.active_emitter];
-            memcpy(forces, Editor.emitters[Editor.active_emitter]->config.forces.data, MAX_FORCES*sizeof(Force));
-            memcpy(colors, Editor.emitters[Editor.active_emitter]->config.gradient.colors, MAX_COLORS*sizeof(Color));
+            *Editor.clipboard = *active;
+            memcpy(forces, active->config.forces.data, MAX_FORCES*sizeof(Force));
+            memcpy(colors, active->config.gradient.colors, MAX_COLORS*sizeof(Color));
             
             // restore the actual clipboard pointers
-            Editor.clipboard->particles.data = particles;
+            Editor.clipboard->particles = backup.particles;
+            Editor.clipboard->particles.limit = active->particles.limit;
             Editor.clipboard->config.gradient.colors = colors;
             Editor.clipboard->config.forces.data = forces;
+            Editor.clipboard->config.atlas.page = (Texture){0}; // the pages can be packed again before pasting
+            EditorRetainTexture(Editor.clipboard->config.atlas.texture);
             
             Editor.clipboard->emit_timer = Editor.clipboard->spawn_timer = 0.0f;
             Editor.clipboard->particles.count = 1;
@@ -207,41 +683,29 @@ void UpdateEditor()
             if(Editor.clipboard != NULL) 
             {
                 // erase emitter content
-                memset(Editor.emitters[Editor.active_emitter]->particles.data, 0, MAX_PARTICLES*sizeof(Particle));
-                memset(Editor.emitters[Editor.active_emitter]->config.gradient.colors, 0, MAX_COLORS*sizeof(Color));
-                memset(Editor.emitters[Editor.active_emitter]->config.forces.data, 0, MAX_FORCES*sizeof(Force));
+                EmitterResetParticles(active);
+                memset(active->config.gradient.colors, 0, MAX_COLORS*sizeof(Color));
+                memset(active->config.forces.data, 0, MAX_FORCES*sizeof(Force));
                 
-                // unload texture only if not in use
-                bool unload = true;
-                for(int i=0; i<Editor.emitter_count; ++i) 
-                {
-                    if(i != Editor.active_emitter && Editor.emitters[i]->config.atlas.texture.id == Editor.emitters[Editor.active_emitter]->config.atlas.texture.id) {
-                        unload = false; 
-                        break;
-                    }
-                }
-                
-                // also check the clipboard texture
-                if(Editor.emitters[Editor.active_emitter]->config.atlas.texture.id == Editor.clipboard->config.atlas.texture.id) {
-                    unload = false; 
-                }
-                
-                if(unload) UnloadTexture(Editor.emitters[Editor.active_emitter]->config.atlas.texture);
+                EditorReleaseTexture(active->config.atlas.texture);
                 
                 // backup pointers
-                Particle* particles = Editor.emitters[Editor.active_emitter]->particles.data;
-                Color* colors = Editor.emitters[Editor.active_emitter]->config.gradient.colors;
-                Force* forces = Editor.emitters[Editor.active_emitter]->config.forces.data;
+                Emitter backup = *active;
+                Color* colors = active->config.gradient.colors;
+                Force* forces = active->config.forces.data;
                 
                 // overwrite emitter with the clipboard data
-                *Editor.emitters[Editor.active_emitter] = *Editor.clipboard;
+                *active = *Editor.clipboard;
                 memcpy(forces, Editor.clipboard->config.forces.data, MAX_FORCES*sizeof(Force));
                 memcpy(colors, Editor.clipboard->config.gradient.colors, MAX_COLORS*sizeof(Color));
                 
                 // restore emitter pointers
-                Editor.emitters[Editor.active_emitter]->particles.data = particles;
-                Editor.emitters[Editor.active_emitter]->config.gradient.colors = colors;
-                Editor.emitters[Editor.active_emitter]->config.forces.data = forces;
+                active->particles = backup.particles;
+                active->particles.limit = Editor.clipboard->particles.limit;
+                active->rng = backup.rng; // keep its own random stream (otherwise it would spawn the same particles as the copied emitter)
+                active->config.gradient.colors = colors;
+                active->config.forces.data = forces;
+                EditorRetainTexture(Editor.clipboard->config.atlas.texture);
             }
         }
     }
@@ -257,30 +721,15 @@ void UpdateEditor()
         if(IsFileExtension(file[0], ".png")) 
         {
             // user dropped a texture
-            if(Editor.active_emitter != -1) 
+            if(active != NULL) 
             {
-                Texture t = LoadTexture(file[0]);
+                Texture t = EditorAcquireTexture(file[0]);
                 if(t.id > 0) 
                 {
-                    bool unload = true;
-                    // only unload if no other emitter has the texture in use 
-                    for(int i=0; i<Editor.emitter_count; ++i) 
-                    {
-                        if(i != Editor.active_emitter && Editor.emitters[i]->config.atlas.texture.id == Editor.emitters[Editor.active_emitter]->config.atlas.texture.id) {
-                            unload = false; 
-                            break;
-                        }
-                    }
-                    
-                    // check for clipboard texture
-                    if(Editor.clipboard != NULL && Editor.emitters[Editor.active_emitter]->config.atlas.texture.id == Editor.clipboard->config.atlas.texture.id) {
-                        unload = false; 
-                    }
-                    
-                    if(unload) UnloadTexture(Editor.emitters[Editor.active_emitter]->config.atlas.texture);
-                    
-                    Editor.emitters[Editor.active_emitter]->config.atlas.texture = t;
-                    Editor.emitters[Editor.active_emitter]->config.atlas.hframes = Editor.emitters[Editor.active_emitter]->config.atlas.vframes = 0;
+                    EditorReleaseTexture(active->config.atlas.texture);
+                    active->config.atlas.texture = t;
+                    active->config.atlas.page = (Texture){0};
+                    active->config.atlas.hframes = active->config.atlas.vframes = 0;
                     Editor.active_window = 2; // switch to texture window
                 }
             } 
@@ -305,10 +754,45 @@ void UpdateEditor()
     // Update emitters
     // ---------------------------------------------------------------------------------------
     Editor.statistics.updated = 0;
-    for(int i=0; i<Editor.emitter_count; ++i) 
+    
+    // scale down the emission if the particles took too long last frame
+    Editor.budget.budget = Editor.options.budget_ms/1000.0f;
+    ParticlesBudgetUpdate(&Editor.budget, Editor.emitters, Editor.emitter_count);
+    ParticlesBudgetBegin(&Editor.budget);
+    
+    if(Editor.options.fixed_step) 
+    {
+        // advance the clock once so all the emitters run the same number of steps
+        Editor.clock.step = 1.0f/Editor.options.step_rate;
+        ParticlesClockAdvance(&Editor.clock, GetFrameTime());
+    }
+    
+#if defined(PARTICLES_THREADS)
+    if(Editor.pool != NULL) 
+    {
+        // returns after all the emitters are updated so they are safe to draw
+        Editor.statistics.updated = ParticlesPoolUpdate(Editor.pool, Editor.emitters, Editor.emitter_count, GetFrameTime(), 
+            Editor.options.fixed_step ? &Editor.clock : NULL);
+    }
+    else
+#endif
+    if(Editor.options.fixed_step) 
     {
-        Editor.statistics.updated += EmitterUpdate(Editor.emitters[i]);
+        for(int i=0; i<Editor.emitter_count; ++i) 
+            Editor.statistics.updated += EmitterUpdateFixed(Editor.emitters[i], &Editor.clock, NULL);
     }
+    else 
+    {
+        for(int i=0; i<Editor.emitter_count; ++i) 
+            Editor.statistics.updated += EmitterUpdate(Editor.emitters[i]);
+    }
+    
+    // grow or shrink the particle memory to what each emitter needs
+    for(int i=0; i<Editor.emitter_count; ++i) 
+        EditorFitEmitter(Editor.emitters[i]);
+    ParticlesBudgetEnd(&Editor.budget);
+    
+    EditorSyncAtlas();
     // ---------------------------------------------------------------------------------------
 }
 
@@ -351,15 +835,22 @@ void DrawEditor()
             DrawTexture(Editor.placeholder, (GetScreenWidth()-Editor.placeholder.width)/2, (GetScreenHeight()-Editor.placeholder.height)/2, WHITE);
         
         EmitterExtraParams params = {0};
-        params.screen = &((Rectangle){-Editor.camera.offset.x, -Editor.camera.offset.y, GetScreenWidth(), GetScreenHeight()});
+        Rectangle view = GetCameraViewRect(Editor.camera, GetScreenWidth(), GetScreenHeight()); // only draw what the camera can see
+        params.screen = &view;
+        if(Editor.options.fixed_step) params.clock = &Editor.clock;
+        params.keep_blend_mode = true; // emitters with the same blend mode and texture (or atlas page) go in the same batch
         
         // draw emitters
+        const int active = EditorGetEmitterIndex(Editor.active_emitter);
         for(int i=0; i<Editor.emitter_count; ++i)
         {
+            ParticlesBudgetBegin(&Editor.budget);
             EmitterDraw(Editor.emitters[i], &params);
+            ParticlesBudgetEnd(&Editor.budget);
             
-            if(Editor.options.show_debug && Editor.active_emitter == i) 
+            if(Editor.options.show_debug && active == i) 
             {
+                EndBlendMode();
                 // draw debug info for active emitter
                 Vector2 pos = Editor.emitters[i]->position;
                 DrawCircleLines(pos.x, pos.y, 4.0f, Editor.options.debug);
@@ -391,8 +882,14 @@ void DrawEditor()
                         const float height = Editor.emitters[i]->config.container.opt2;
                         DrawRectangleLines(pos.x-width/2, pos.y-height/2, width, height, Editor.options.debug);
                 }
+                
+                // draw the box around the particles (used to cull the whole emitter)
+                const Rectangle bounds = EmitterGetBounds(Editor.emitters[i]);
+                if(bounds.width > 0.0f && bounds.height > 0.0f) 
+                    DrawRectangleLinesEx(bounds, 1, Fade(Editor.options.debug, 0.5f));
             }
         }
+        EndBlendMode();
 
         Editor.statistics.drawn = params.drawn;
         Editor.statistics.pixels = params.pixels;
@@ -419,112 +916,58 @@ static inline void SetDefaultEmitterConfig(Emitter* e)
     e->config.speed.min = e->config.speed.max = 80.0f;
     e->config.angle.max = 360.0f;
     e->config.easing = &EaseLinearNone;
+    e->config.sort = EMITTER_SORT_SPAWN_TIME; // the default blend mode depends on the draw order
     e->delay = 0.0f;
     e->life = 4.0f;
 }
 
-void EditorAddEmitter(Vector2 loc) 
+EmitterHandle EditorAddEmitter(Vector2 loc) 
 {
-    if(Editor.emitter_count < MAX_EMITTERS)
-    {
-        int pos = Editor.emitter_count;
-        
-        // allocate memory for emitter
-        if(Editor.emitters[pos] == NULL) {
-            Editor.emitters[pos] = calloc(1, sizeof(Emitter));
-            if(Editor.emitters[pos] == NULL) TraceLog(LOG_FATAL, "EMITTER: Failed to allocate memory");
-            Editor.statistics.total_mem += sizeof(Emitter);
-        }
-        
-        *Editor.emitters[pos] = (Emitter){0};
-        // set default configuration for the new emitter
-        SetDefaultEmitterConfig(Editor.emitters[pos]);
-        
-        // allocate memory for emitter particles
-        if(Editor.emitters[pos]->particles.data == NULL) {
-            Editor.emitters[pos]->particles.data = calloc(MAX_PARTICLES, sizeof(Particle));
-            if(Editor.emitters[pos]->particles.data == NULL) TraceLog(LOG_FATAL, "PARTICLES: Failed to allocate memory");
-            Editor.emitters[pos]->particles.max = MAX_PARTICLES;
-            Editor.statistics.total_mem += MAX_PARTICLES*sizeof(Particle);
-        }
-        Editor.emitters[pos]->particles.count = 0;
-        
-        // allocate memory for the colors
-        if(Editor.emitters[pos]->config.gradient.colors == NULL) {
-            Editor.emitters[pos]->config.gradient.colors = calloc(MAX_COLORS, sizeof(Color));
-            if(Editor.emitters[pos]->config.gradient.colors == NULL) TraceLog(LOG_FATAL, "COLORS: Failed to allocate memory");
-            Editor.statistics.total_mem += MAX_COLORS*sizeof(Color);
-        }
-        Editor.emitters[pos]->config.gradient.count = 1; // at least one color should always be set
-        Editor.emitters[pos]->config.gradient.colors[0] = GenerateRandomColor(0.4f, 0.89f);
-        
-        // allocate memory for the forces
-        if(Editor.emitters[pos]->config.forces.data == NULL) {
-            Editor.emitters[pos]->config.forces.data = calloc(MAX_FORCES, sizeof(Force));
-            if(Editor.emitters[pos]->config.forces.data == NULL) TraceLog(LOG_FATAL, "FORCES: Failed to allocate memory");
-            Editor.statistics.total_mem += MAX_FORCES*sizeof(Force);
-        }
-        Editor.emitters[pos]->config.forces.count = 0;
-        
-        Editor.emitters[pos]->position = loc;
-        
-        Editor.emitter_count += 1;
-    }
+    // get a new emitter from the arena (comes zeroed with the gradient, forces and particles set up)
+    Emitter* e = EditorAllocateEmitter(0);
+    
+    // set default configuration for the new emitter (and size the particles for it)
+    SetDefaultEmitterConfig(e);
+    e->particles.limit = MAX_PARTICLES;
+    EditorFitEmitter(e);
+    e->config.gradient.count = 1; // at least one color should always be set
+    e->config.gradient.colors[0] = GenerateRandomColor(0.4f, 0.89f);
+    e->config.forces.count = 0;
+    
+    e->position = loc;
+    
+    return EditorInsertEmitter(e);
 }
 
 void EditorRemoveEmitter()
 {
     if(Editor.emitter_count > 0)
     {
-        int pos = Editor.emitter_count - 1;
-        if(Editor.active_emitter == pos) Editor.active_emitter = pos - 1;
-        
-        free(Editor.emitters[pos]->particles.data);
-        free(Editor.emitters[pos]->config.gradient.colors);
-        free(Editor.emitters[pos]->config.forces.data);
-        
-        if(Editor.clipboard == NULL || (Editor.clipboard != NULL && Editor.clipboard->config.atlas.texture.id != Editor.emitters[pos]->config.atlas.texture.id))
-            UnloadTexture(Editor.emitters[pos]->config.atlas.texture);
+        // remove the active emitter (or the last one when none is active)
+        const int active = EditorGetEmitterIndex(Editor.active_emitter);
+        Emitter* e = EditorTakeEmitter((active != -1) ? Editor.active_emitter : EditorGetEmitterHandle(Editor.emitter_count - 1));
+        EditorFreeEmitter(e); // also releases its texture
         
-        free(Editor.emitters[pos]);
-        Editor.emitters[pos] = NULL;
-        
-        Editor.emitter_count -= 1;
-        Editor.statistics.total_mem -= sizeof(Emitter) + MAX_PARTICLES*sizeof(Particle) + MAX_COLORS*sizeof(Color) + MAX_FORCES*sizeof(Force);
+        // select the emitter that took its place (none when it was the last one)
+        if(active != -1) Editor.active_emitter = EditorGetEmitterHandle((active < Editor.emitter_count) ? active : Editor.emitter_count - 1);
     }
 }
 
 void EditorMoveUpEmitter()
 {
-    if(Editor.active_emitter > 0) 
-    {
-        // swap current active emitter with the one above it
-        Emitter* tmp = Editor.emitters[Editor.active_emitter];
-        Editor.emitters[Editor.active_emitter] = Editor.emitters[Editor.active_emitter - 1];
-        Editor.emitters[Editor.active_emitter - 1] = tmp;
-        
-        //do the same with the ids
-        int tid = Editor.emitter_id[Editor.active_emitter];
-        Editor.emitter_id[Editor.active_emitter] = Editor.emitter_id[Editor.active_emitter - 1];
-        Editor.emitter_id[Editor.active_emitter - 1] = tid;
-        Editor.active_emitter -= 1;
+    const int active = EditorGetEmitterIndex(Editor.active_emitter);
+    if(active > 0) {
+        // swap current active emitter with the one above it (its handle stays the same)
+        EditorSwapEmitters(active, active - 1);
     }
 }
 
 void EditorMoveDownEmitter()
 {
-    if(Editor.active_emitter != -1 && Editor.active_emitter + 1 < Editor.emitter_count) {
-        // swap current active emitter with the one below it
-        Emitter* tmp = Editor.emitters[Editor.active_emitter];
-        Editor.emitters[Editor.active_emitter] = Editor.emitters[Editor.active_emitter + 1];
-        Editor.emitters[Editor.active_emitter + 1] = tmp;
-        
-        //do the same with the ids
-        int tid = Editor.emitter_id[Editor.active_emitter];
-        Editor.emitter_id[Editor.active_emitter] = Editor.emitter_id[Editor.active_emitter + 1];
-        Editor.emitter_id[Editor.active_emitter + 1] = tid;
-        
-        Editor.active_emitter += 1;
+    const int active = EditorGetEmitterIndex(Editor.active_emitter);
+    if(active != -1 && active + 1 < Editor.emitter_count) {
+        // swap current active emitter with the one below it (its handle stays the same)
+        EditorSwapEmitters(active, active + 1);
     }
 }
 
@@ -532,8 +975,7 @@ void EditorSyncEmitters()
 {
     // reset all emitter particles so they are in sync
     for(int i=0; i<Editor.emitter_count; ++i) {
-        memset(Editor.emitters[i]->particles.data, 0, MAX_PARTICLES*sizeof(Particle));
-        Editor.emitters[i]->particles.count = 0;
+        EmitterResetParticles(Editor.emitters[i]);
         Editor.emitters[i]->spawn_timer = 0.0f;
         Editor.emitters[i]->emit_timer = 0.0f;
     }
@@ -21,7 +21,6 @@
 
 #define EDITOR_VER "1.04 - ALPHA"
 
-#define MAX_EMITTERS 8
 #define MAX_PARTICLES 2000
 #define MAX_COLORS 16
 #define MAX_FORCES 4
@@ -30,14 +29,70 @@
 #define SIZEOF(A) (sizeof(A)/sizeof(A[0]))
 #endif
 
+#define ATLAS_PAGE_SIZE 2048                 // size of the pages the emitter textures get packed in
+#define ATLAS_MAX_PAGES 4
+
+#define ARENA_ALIGNMENT 64                  // every block starts on a cache line
+#define ARENA_CHUNK_SIZE (2*1024*1024)      // memory is requested from the system in chunks of this size (a huge page)
+#define ARENA_CLASSES 96                    // number of size classes (4 per power of two, the biggest is 2GB)
+
+// Memory of all the emitters, blocks are carved from big chunks and reused through a free list for each size class
+// (compile with -DEDITOR_HUGE_PAGES to map the chunks with huge pages on linux)
+typedef struct {
+    struct ArenaChunk* chunks;      // chunks mapped so far (the first one is carved from)
+    struct ArenaChunk* large;       // chunks holding a single block too big for a normal chunk (never carved from)
+    void* free[ARENA_CLASSES];      // freed blocks of each size class
+    size_t used;                    // bytes in blocks handed out
+    size_t total;                   // bytes requested from the system
+} SArena;
+
+// Handle to an emitter in the editor pool, it goes stale (instead of pointing to another emitter) once the emitter is removed
+typedef struct {
+    int slot;                       // never changes while the emitter is alive (used as its id in the gui)
+    unsigned int generation;        // generation of the slot when the handle was made (0 is never valid)
+} EmitterHandle;
+
+// A texture shared by every emitter using the same file (or a file with the same contents)
+typedef struct {
+    Texture texture;
+    int refs;                       // emitters (and the clipboard) holding it, it gets unloaded when this drops to 0
+    unsigned int generation;        // bumped when the texture is unloaded so its keys in the map go stale
+} STexture;
+
+// Key of a texture in the registry map (by path, content hash or texture id)
+typedef struct {
+    uint64_t key;
+    int entry;                      // index in `entries`
+    unsigned int generation;        // generation of the entry when the key was added (0 is an empty bucket)
+    long mod_time;                  // modification time of the file when it was loaded (only for path keys)
+} STextureKey;
+
+// Textures loaded by the editor, found in O(1) when acquiring and releasing them
+typedef struct {
+    STexture* entries;
+    int* free;                      // stack of unused entries
+    int count, free_count, capacity;
+    STextureKey* map;               // open addressing with linear probing (the size is a power of two)
+    int map_used;                   // buckets that are not empty (stale keys included)
+    int map_capacity;
+} STextureRegistry;
 
 struct SEditor 
 {
-    Emitter* emitters[MAX_EMITTERS];
-    int emitter_id[MAX_EMITTERS];
+    Emitter** emitters;         // alive emitters packed in draw order (this is what gets updated and drawn)
+    int* emitter_id;            // slot of each emitter in `emitters`
     int emitter_count;
+    int emitter_capacity;       // size of all the pool arrays
+    
+    struct {
+        int* dense;                 // index in `emitters` of the emitter in each slot (-1 when the slot is free)
+        unsigned int* generation;   // bumped every time the slot is freed
+        int* free;                  // stack of free slots
+        int free_count;
+        int count;                  // slots used so far
+    } slots;
     
-    int active_emitter;
+    EmitterHandle active_emitter;   // selected emitter (none when the handle is zeroed or stale)
     int active_color;
     int active_window;
     
@@ -48,11 +103,29 @@ struct SEditor
     
     Emitter* clipboard;
     
+    SArena arena;               // holds the emitters, their gradients, forces and particles
+    STextureRegistry textures;  // emitter textures (the placeholder is not in it)
+    
+    struct {
+        Texture pages[ATLAS_MAX_PAGES];
+        int count;
+        unsigned int hash;      // hash of the emitter textures when they were packed (packed again when it changes)
+    } atlas;
+    ParticlesClock clock;       // used when updating with a fixed time step
+    ParticlesBudget budget;     // scales down the emission when the particles take too long
+#if defined(PARTICLES_THREADS)
+    ParticlesPool* pool;        // updates the emitters in parallel
+#endif
+    
     struct SOptions 
     {
         bool show_placeholder;
         bool show_grid;
         bool show_debug;
+        bool fixed_step;        // update the emitters with a fixed time step
+        int step_rate;          // fixed steps per second
+        int budget_ms;          // milliseconds per frame the particles can take (0 disables the budget)
+        bool pack_atlas;        // draw the emitter textures from shared atlas pages
         Color gridcolor;
         Color debug;
         Color fg;
@@ -64,7 +137,6 @@ struct SEditor
         int drawn;      // total number of particles drawn on the screen each frame
         int updated;    // total number of particles updated per frame
         unsigned long long  pixels;
-        int total_mem;
     } statistics;
     
     char name[MAX_NAME_LEN];
@@ -79,9 +151,23 @@ void DrawGUI();
 void DrawGridSystem();
 bool CanMoveEmitter();
 void DeallocateEmitters();
+void* ArenaAlloc(SArena* arena, size_t size);
+void ArenaFree(SArena* arena, void* ptr, size_t size);
+void ArenaRelease(SArena* arena);
+Emitter* EditorAllocateEmitter(int max);
+void EditorFitEmitter(Emitter* e);
+void EditorFreeEmitter(Emitter* e);
+Texture EditorAcquireTexture(const char* path);
+Texture EditorRetainTexture(Texture texture);
+void EditorReleaseTexture(Texture texture);
 int SaveEmitters(const char* file);
 int LoadEmitters(const char* file);
-void EditorAddEmitter(Vector2 loc);
+EmitterHandle EditorInsertEmitter(Emitter* e);
+Emitter* EditorGetEmitter(EmitterHandle handle);
+EmitterHandle EditorGetEmitterHandle(int index);
+int EditorGetEmitterIndex(EmitterHandle handle);
+Emitter* EditorTakeEmitter(EmitterHandle handle);
+EmitterHandle EditorAddEmitter(Vector2 loc);
 void EditorRemoveEmitter(void);
 void EditorMoveUpEmitter(void);
 void EditorMoveDownEmitter(void);
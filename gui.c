@@ -32,6 +32,7 @@
 // ---------------------------------------------------------------------------------------
 #define EMITTER_TYPE_NAMES "Point;Rect;Circle;Ring"
 #define EMITTER_BLEND_MODES "Alpha;Additive;Multiply;AddColors; SubColors"
+#define EMITTER_SORT_NAMES "None;Spawn Time;Remaining Life;Depth"
 
 #define EASING_NAMES "Linear;SineIn;SineOut;SineInOut;CircIn;CircOut;CircInOut;CubicIn;CubicOut;CubicInOut; \
     QuadIn;QuadOut;QuadInOut;ExpoIn;ExpoOut;ExpoInOut;BackIn;BackOut;BackInOut;BounceIn;BounceOut;BounceInOut; \
@@ -88,6 +89,8 @@ static void EmitterWindow(Rectangle bounds)
         DELAY_EMITTER_PROP,
         
         BLEND_MODES_EMITTER_PROP,
+        SORT_EMITTER_PROP,
+        PRIORITY_EMITTER_PROP,
         
         SIZE_SECTION_EMITTER_PROP,
         SIZE_MIN_EMITTER_PROP,
@@ -153,6 +156,8 @@ static void EmitterWindow(Rectangle bounds)
         PFLOATPTR_RANGE("Delay", 0, NULL, 1.0, 3, 0.0f, 60.0f),
         
         PSELECT("Blend Mode", 0, (char*)EMITTER_BLEND_MODES, 0),
+        PSELECT("Sort", 0, (char*)EMITTER_SORT_NAMES, 0),
+        PFLOATPTR_RANGE("Priority", 0, NULL, 0.1f, 2, 0.0f, 1.0f),
         
         PSECTION("Size", 0, 2),
         PFLOATPTR_RANGE("min", 0, NULL,  0.1f, 2, 0.0f, 10.0f),
@@ -195,7 +200,7 @@ static void EmitterWindow(Rectangle bounds)
         PINT("[2]", GUI_PFLAG_DISABLED, 0),
     };
     
-    Emitter* e = Editor.emitters[Editor.active_emitter]; // get the active emitter
+    Emitter* e = EditorGetEmitter(Editor.active_emitter); // get the active emitter
     
     // get index of the easing used by the active emitter
     // using a map will be better but meh, too much work
@@ -232,6 +237,8 @@ static void EmitterWindow(Rectangle bounds)
     PSET_SELECT_ACTIVE(prop, EASING_EMITTER_PROP, easing_idx);
     PSET_FLOATPTR(prop, DELAY_EMITTER_PROP, &e->delay);
     PSET_SELECT_ACTIVE(prop, BLEND_MODES_EMITTER_PROP, e->mode);
+    PSET_SELECT_ACTIVE(prop, SORT_EMITTER_PROP, e->config.sort);
+    PSET_FLOATPTR(prop, PRIORITY_EMITTER_PROP, &e->priority);
     PSET_FLOATPTR(prop, SIZE_MIN_EMITTER_PROP, &e->config.size.min);
     PSET_FLOATPTR(prop, SIZE_MAX_EMITTER_PROP, &e->config.size.max);
     PSET_FLOATPTR(prop, SCALE_START_EMITTER_PROP, &e->config.scale.start);
@@ -286,6 +293,7 @@ static void EmitterWindow(Rectangle bounds)
     easing_idx = PGET_SELECT_ACTIVE(prop, EASING_EMITTER_PROP);
     e->config.easing = Easings[easing_idx];
     e->mode = PGET_SELECT_ACTIVE(prop, BLEND_MODES_EMITTER_PROP);
+    e->config.sort = PGET_SELECT_ACTIVE(prop, SORT_EMITTER_PROP);
     e->config.container.type = PGET_SELECT_ACTIVE(prop, TYPE_EMITTER_PROP);
     // set flags
     for(int i=0; i<SIZEOF(flags); ++i) {
@@ -294,8 +302,7 @@ static void EmitterWindow(Rectangle bounds)
     }
     // reset particles if the pulses property has changed
     if(pulses != e->config.pulses) {
-        memset(e->particles.data, 0, MAX_PARTICLES*sizeof(Particle));
-        e->particles.count = 0;
+        EmitterResetParticles(e);
     }
 }
 
@@ -303,7 +310,7 @@ static void ColorWindow(Rectangle bounds)
 {
     GuiPanel(bounds);
     
-    Emitter* e = Editor.emitters[Editor.active_emitter]; // get the active emitter
+    Emitter* e = EditorGetEmitter(Editor.active_emitter); // get the active emitter
     
     if(Editor.active_color >= e->config.gradient.count) Editor.active_color = 0;
     
@@ -363,7 +370,7 @@ static void ColorWindow(Rectangle bounds)
 static void ForcesWindow(Rectangle bounds) 
 {
     GuiPanel(bounds);
-    Emitter* e = Editor.emitters[Editor.active_emitter]; // get the active emitter
+    Emitter* e = EditorGetEmitter(Editor.active_emitter); // get the active emitter
     
     Rectangle item = {bounds.x+2, bounds.y+2, bounds.width-4, 0};
     // populate the forces property list
@@ -411,7 +418,12 @@ static void OptionsWindow(Rectangle bounds)
         PCOLOR("Background", 0, 0, 0, 0, 0),
         PCOLOR("Foreground", 0, 0, 0, 0, 0),
         PCOLOR("Grid Color", 0, 0, 0, 0, 0),
-        PCOLOR("Debug", 0, 0, 0, 0, 0)
+        PCOLOR("Debug", 0, 0, 0, 0, 0),
+        
+        PBOOLPTR("Fixed Step", 0, &Editor.options.fixed_step),
+        PINTPTR_RANGE("Step Rate", 0, &Editor.options.step_rate, 1, 10, 240),
+        PINTPTR_RANGE("Budget (ms)", 0, &Editor.options.budget_ms, 1, 0, 33),
+        PBOOLPTR("Pack Atlas", 0, &Editor.options.pack_atlas)
     };
     
     PSET_COLOR(prop, 3, Editor.options.bg);
@@ -438,7 +450,7 @@ static void OptionsWindow(Rectangle bounds)
 static void TextureWindow(Rectangle bounds)
 {
     GuiPanel(bounds);
-    Emitter* e = Editor.emitters[Editor.active_emitter]; // get the active emitter
+    Emitter* e = EditorGetEmitter(Editor.active_emitter); // get the active emitter
     
     Rectangle item = {bounds.x+2, bounds.y+2, bounds.width-4, bounds.width-4};
     if(e->config.atlas.texture.id < 1) 
@@ -456,22 +468,7 @@ static void TextureWindow(Rectangle bounds)
         item.height = 30;
         if(GuiButton(item, "Clear Texture")) 
         {
-            bool unload = true;
-            // only unload if no other emitter has the texture in use 
-            for(int i=0; i<Editor.emitter_count; ++i) {
-                if(i != Editor.active_emitter && Editor.emitters[i]->config.atlas.texture.id == e->config.atlas.texture.id) {
-                    unload = false; 
-                    break;
-                }
-            }
-            
-            // check for clipboard texture
-            if(Editor.clipboard != NULL && e->config.atlas.texture.id == Editor.clipboard->config.atlas.texture.id) {
-                unload = false; 
-            }
-            
-            if(unload) UnloadTexture(e->config.atlas.texture);
-            
+            EditorReleaseTexture(e->config.atlas.texture);
             e->config.atlas.texture = (Texture){0};
             e->config.atlas.vframes = e->config.atlas.hframes = 0;
         }
@@ -521,14 +518,22 @@ void EditorButtons(Rectangle bounds)
 {
     GuiSetStyle(LABEL, TEXT_ALIGNMENT, GUI_TEXT_ALIGN_CENTER);
     
-    // Draw all the available emitters
-    for(int i=0; i<Editor.emitter_count; ++i)
+    // Draw the emitters that fit above the other buttons (scroll the column with the mouse wheel to see the rest)
+    static int first = 0;
+    const int rows = (GetScreenHeight() - bounds.y)/(GUI_BUTTON_SIZE + 1) - 6;
+    const Rectangle column = {bounds.x, bounds.y, bounds.width, (rows > 0 ? rows : 0)*(GUI_BUTTON_SIZE + 1)};
+    if(CheckCollisionPointRec(GetMousePosition(), column)) first -= (int)GetMouseWheelMove();
+    if(first > Editor.emitter_count - rows) first = Editor.emitter_count - rows;
+    if(first < 0) first = 0;
+    
+    const int active = EditorGetEmitterIndex(Editor.active_emitter);
+    for(int i=first; i<Editor.emitter_count && i<first+rows; ++i)
     {
         int color = GuiGetStyle(LABEL, TEXT_COLOR_NORMAL);
-        if(i == Editor.active_emitter) GuiSetStyle(LABEL, TEXT_COLOR_NORMAL, ColorToInt(Editor.options.debug));
+        if(i == active) GuiSetStyle(LABEL, TEXT_COLOR_NORMAL, ColorToInt(Editor.options.debug));
         else GuiSetStyle(LABEL, TEXT_COLOR_NORMAL, ColorToInt(Editor.options.fg));
         if(GuiLabelButton(bounds, TextFormat("%02i", Editor.emitter_id[i]+1))) {
-            Editor.active_emitter = i;
+            Editor.active_emitter = EditorGetEmitterHandle(i);
         }
         GuiSetStyle(LABEL, TEXT_COLOR_NORMAL, color);
         bounds.y += GUI_BUTTON_SIZE + 1;
@@ -541,7 +546,7 @@ void EditorButtons(Rectangle bounds)
     
     // REMOVE EMITTER BUTTON
     bounds.y += GUI_BUTTON_SIZE + 1;
-    if(CheckCollisionPointRec(mouse, bounds)) GuiSetTooltip("Remove last emitter");
+    if(CheckCollisionPointRec(mouse, bounds)) GuiSetTooltip("Remove emitter");
     if(GuiLabelButton(bounds, "#09#")) EditorRemoveEmitter();
     
     // MOVE UP BUTTON
@@ -557,7 +562,7 @@ void EditorButtons(Rectangle bounds)
     // CLOSE WINDOW BUTTON
     bounds.y += GUI_BUTTON_SIZE + 1;
     if(CheckCollisionPointRec(mouse, bounds)) GuiSetTooltip("Close Window");
-    if(GuiLabelButton(bounds, "#113#")) Editor.active_emitter = -1;
+    if(GuiLabelButton(bounds, "#113#")) Editor.active_emitter = (EmitterHandle){0};
     
     // SYNC BUTTON
     bounds.y += GUI_BUTTON_SIZE + 1;
@@ -591,7 +596,8 @@ void DrawGUI()
 {
     // Calculate bounds for the window on the right side
     Rectangle bounds = {GetScreenWidth()-GUI_WINDOW_SIZE-GUI_BUTTON_SIZE, 2, GUI_BUTTON_SIZE, GUI_BUTTON_SIZE};
-    if(Editor.active_emitter == -1) bounds.x += GUI_WINDOW_SIZE;
+    const bool selected = EditorGetEmitter(Editor.active_emitter) != NULL;
+    if(!selected) bounds.x += GUI_WINDOW_SIZE;
     
     // Draw FPS
     const char* fmt = Editor.statistics.shown ? "#120#FPS %i" : "#119#FPS %i";
@@ -607,26 +613,31 @@ void DrawGUI()
         int used_mem = 0;
         char* umu = "";
         for(int i=0; i<Editor.emitter_count; ++i) {
-            used_mem += Editor.emitters[i]->particles.count*sizeof(Particle) +
+            used_mem += Editor.emitters[i]->particles.count*PARTICLE_BYTES + Editor.emitters[i]->particles.sort_max*PARTICLE_SORT_BYTES +
+                Editor.emitters[i]->particles.previous_max*PARTICLE_PREVIOUS_BYTES +
                 Editor.emitters[i]->config.gradient.count*sizeof(Color) + Editor.emitters[i]->config.forces.count*sizeof(Force);
         }
         FORMAT_MEASUREMENT(used_mem, used_mem, umu, 1024);
         
-        int total_mem = Editor.statistics.total_mem;
+        int total_mem = Editor.arena.used; // blocks handed out by the arena
         char* tmu = "";
         FORMAT_MEASUREMENT(total_mem, total_mem, tmu, 1024);
         
-        DrawText(TextFormat("updated %d\ndrawn %d\npixels %.2f%s\nused_mem %d%s\ntotal_mem %d%s", Editor.statistics.updated, Editor.statistics.drawn, 
-            pixels, pu, used_mem, umu, total_mem, tmu), 10, 35, 10, Editor.options.fg);
+        int arena_mem = Editor.arena.total; // memory the arena got from the system
+        char* amu = "";
+        FORMAT_MEASUREMENT(arena_mem, arena_mem, amu, 1024);
+        
+        DrawText(TextFormat("updated %d\ndrawn %d\npixels %.2f%s\nused_mem %d%s\ntotal_mem %d%s\narena_mem %d%s\nscale %.2f (%.2fms)", Editor.statistics.updated, Editor.statistics.drawn, 
+            pixels, pu, used_mem, umu, total_mem, tmu, arena_mem, amu, Editor.budget.scale, Editor.budget.cost*1000.0f), 10, 35, 10, Editor.options.fg);
     }
     
     // Draw the name input at the top of the screen
-    EditorNameInput((Rectangle){74.0f, 2.0f, (Editor.active_emitter == -1) ? GetScreenWidth()-GUI_BUTTON_SIZE-70 : GetScreenWidth()-GUI_WINDOW_SIZE-GUI_BUTTON_SIZE-70, GUI_BUTTON_SIZE});
+    EditorNameInput((Rectangle){74.0f, 2.0f, !selected ? GetScreenWidth()-GUI_BUTTON_SIZE-70 : GetScreenWidth()-GUI_WINDOW_SIZE-GUI_BUTTON_SIZE-70, GUI_BUTTON_SIZE});
     
     // Draw the buttons on the right side
     EditorButtons(bounds);
     
-    if(Editor.active_emitter == -1 || Editor.emitter_count == 0 ) return;
+    if(EditorGetEmitter(Editor.active_emitter) == NULL) return; // the buttons can change the selection
     
     // Draw the window on the right side
     bounds = (Rectangle){GetScreenWidth()-GUI_WINDOW_SIZE, -1, GUI_WINDOW_SIZE+1, GetScreenHeight()-45 };
@@ -665,7 +676,9 @@ int SaveEmitters(const char* file)
         "#\tf ID forces_count f0_direction f0_strength .. fn_direction fn_strength\n"
         "#\ta ID hframes vframes loop texture\n"
         "#\tc ID emission pulses size_min size_max angle_min angle_max offset_min offset_max age_min age_max speed_min speed_max scale_start scale_end acc_start acc_end tacc_start tacc_end rot_start rot_end\n"
-        "#\te ID pos_x pos_y max_particles life delay blend_mode easing flags type opt1 opt2\n"
+        "#\te ID pos_x pos_y max_particles life delay blend_mode easing flags type opt1 opt2 sort priority\n"
+        "#\n"
+        "# sort: 0 none (undefined order), 1 spawn time (default when missing), 2 remaining life, 3 depth\n"
         "#\n");
     
     // write placeholder and name of the particle system
@@ -720,9 +733,9 @@ int SaveEmitters(const char* file)
             e->config.acc.start, e->config.acc.end, e->config.tacc.start, e->config.tacc.end, e->config.rotation.start, e->config.rotation.end);
         
         // write emitter
-        // e ID pos_x pos_y max_particles life delay blend_mode easing flags type opt1 opt2
-        fprintf(fp, "e  %02i %.0f %.0f %04i %f %f %02i %04i %i %02i %4.0f %4.0f\n", i, e->position.x, e->position.y, e->particles.max, e->life, e->delay, e->mode, easing_idx, e->flags, 
-            e->config.container.type, e->config.container.opt1, e->config.container.opt2);
+        // e ID pos_x pos_y max_particles life delay blend_mode easing flags type opt1 opt2 sort priority
+        fprintf(fp, "e  %02i %.0f %.0f %04i %f %f %02i %04i %i %02i %4.0f %4.0f %i %.2f\n", i, e->position.x, e->position.y, e->particles.limit, e->life, e->delay, e->mode, easing_idx, e->flags, 
+            e->config.container.type, e->config.container.opt1, e->config.container.opt2, e->config.sort, e->priority);
     }
     
     fclose(fp);
@@ -730,6 +743,39 @@ int SaveEmitters(const char* file)
     return 1;
 }
 
+// Emitters read so far from a file, indexed by their id in the file
+typedef struct {
+    Emitter** emitters;
+    bool* complete;         // set once the `e` line of the emitter is read
+    int count;
+} LoadedEmitters;
+
+// Get the emitter with `id` from the file being loaded (allocated on first use). Returns NULL for invalid ids
+static Emitter* GetLoadedEmitter(LoadedEmitters* loaded, int id) 
+{
+    enum {MAX_EMITTER_ID = 0xFFFF};
+    if(id < 0 || id > MAX_EMITTER_ID) return NULL;
+    
+    if(id >= loaded->count) {
+        const int count = id + 1;
+        Emitter** emitters = realloc(loaded->emitters, count*sizeof(Emitter*));
+        bool* complete = realloc(loaded->complete, count*sizeof(bool));
+        if(emitters != NULL) loaded->emitters = emitters;
+        if(complete != NULL) loaded->complete = complete;
+        if(emitters == NULL || complete == NULL) return NULL;
+        
+        for(int i=loaded->count; i<count; ++i) {
+            loaded->emitters[i] = NULL;
+            loaded->complete[i] = false;
+        }
+        loaded->count = count;
+    }
+    
+    // get the emitter from the arena (the particles are sized once its `e` line is read)
+    if(loaded->emitters[id] == NULL) loaded->emitters[id] = EditorAllocateEmitter(0);
+    return loaded->emitters[id];
+}
+
 int LoadEmitters(const char* file)
 {
     FILE* fp = fopen(file, "rb");
@@ -743,35 +789,20 @@ int LoadEmitters(const char* file)
     
     // reset emitters
     DeallocateEmitters();
-    Editor.emitter_count = 0;
-    Editor.active_emitter = -1;
-    // reset emitter ids
-    for(int i=0; i<MAX_EMITTERS; ++i) {
-        Editor.emitter_id[i] = i;
-    }
+    Editor.active_emitter = (EmitterHandle){0};
+    LoadedEmitters loaded = {0};
     
     while(!feof(fp)) 
     {
         if(buffer[0] == 'g') 
         {
             // parse color gradients
-            int id = MAX_EMITTERS, count = 0, idx = 0, bytes = 0;
-            sscanf(buffer, "g  %02d %02d%n", &id, &count, &bytes);
-            if(id < MAX_EMITTERS && count <= MAX_COLORS) 
+            int id = -1, count = 0, idx = 0, bytes = 0;
+            sscanf(buffer, "g  %d %02d%n", &id, &count, &bytes);
+            Emitter* e = (count <= MAX_COLORS) ? GetLoadedEmitter(&loaded, id) : NULL;
+            if(e != NULL) 
             {
-                if(Editor.emitters[id] == NULL) {
-                    // allocate memory for emitter
-                    Editor.emitters[id] = calloc(1, sizeof(Emitter));
-                    if(Editor.emitters[id] == NULL) TraceLog(LOG_FATAL, "EMITTER: Failed to allocate memory");
-                    Editor.statistics.total_mem += sizeof(Emitter);
-                }
-                
-                if(Editor.emitters[id]->config.gradient.colors == NULL) {
-                    Editor.emitters[id]->config.gradient.colors = calloc(MAX_COLORS, sizeof(Color));
-                    Editor.statistics.total_mem += MAX_COLORS*sizeof(Color);
-                }
-                
-                if(Editor.emitters[id]->config.gradient.colors != NULL)
+                if(e->config.gradient.colors != NULL)
                 {
                     idx += bytes;
                     for(int c=0; c<count; ++c) {
@@ -781,70 +812,52 @@ int LoadEmitters(const char* file)
                             break;
                         }
                         idx += bytes;
-                        Editor.emitters[id]->config.gradient.colors[c] = GetColor(color);
+                        e->config.gradient.colors[c] = GetColor(color);
                     }
-                    Editor.emitters[id]->config.gradient.count = count;
-                } else Editor.emitters[id]->config.gradient.count = 0;
+                    e->config.gradient.count = count;
+                } else e->config.gradient.count = 0;
             }
         }
         else if(buffer[0] == 'f')
         {
             // parse forces
-            int id = MAX_EMITTERS, count = 0, idx = 0, bytes = 0;;
-            sscanf(buffer, "f  %02d %02d%n", &id, &count, &bytes);
-            if(id < MAX_EMITTERS && count <= MAX_FORCES) 
+            int id = -1, count = 0, idx = 0, bytes = 0;
+            sscanf(buffer, "f  %d %02d%n", &id, &count, &bytes);
+            Emitter* e = (count <= MAX_FORCES) ? GetLoadedEmitter(&loaded, id) : NULL;
+            if(e != NULL) 
             {
-                if(Editor.emitters[id] == NULL) {
-                    // allocate memory for emitter
-                    Editor.emitters[id] = calloc(1, sizeof(Emitter));
-                    if(Editor.emitters[id] == NULL) TraceLog(LOG_FATAL, "EMITTER: Failed to allocate memory");
-                    Editor.statistics.total_mem += sizeof(Emitter);
-                }
-                
-                if(Editor.emitters[id]->config.forces.data == NULL) {
-                    Editor.emitters[id]->config.forces.data = calloc(MAX_FORCES, sizeof(Force));
-                    Editor.statistics.total_mem += MAX_FORCES*sizeof(Force);
-                }
-                
-                if(Editor.emitters[id]->config.forces.data != NULL) {
+                if(e->config.forces.data != NULL) {
                     idx += bytes;
                     for(int f=0; f<count; ++f) {
-                        if(sscanf(&buffer[idx], " %f %f%n", &Editor.emitters[id]->config.forces.data[f].direction, 
-                            &Editor.emitters[id]->config.forces.data[f].strength, &bytes) == EOF)
+                        if(sscanf(&buffer[idx], " %f %f%n", &e->config.forces.data[f].direction, 
+                            &e->config.forces.data[f].strength, &bytes) == EOF)
                         {
                             count = f + 1;
                             break;
                         }
                         idx += bytes;
                     }
-                    Editor.emitters[id]->config.forces.count = count;
-                } else Editor.emitters[id]->config.forces.count = 0;
+                    e->config.forces.count = count;
+                } else e->config.forces.count = 0;
             }
         }
         else if(buffer[0] == 'a') 
         {
             // parse atlas
-            int id = MAX_EMITTERS, idx=0, bytes=0;
-            sscanf(buffer, "a  %02d%n", &id, &bytes);
-            if(id < MAX_EMITTERS) 
+            int id = -1, idx=0, bytes=0;
+            sscanf(buffer, "a  %d%n", &id, &bytes);
+            Emitter* e = GetLoadedEmitter(&loaded, id);
+            if(e != NULL) 
             {
-                if(Editor.emitters[id] == NULL) {
-                    // allocate memory for emitter
-                    Editor.emitters[id] = calloc(1, sizeof(Emitter));
-                    if(Editor.emitters[id] == NULL) TraceLog(LOG_FATAL, "EMITTER: Failed to allocate memory");
-                    Editor.statistics.total_mem += sizeof(Emitter);
-                }
-                
                 idx += bytes;
                 char texture[128] = {0};
-                Emitter* e = Editor.emitters[id];
                 sscanf(&buffer[idx], " %3d %3d %3d %127[^\r\n]s\n", &e->config.atlas.hframes, &e->config.atlas.vframes, &e->config.atlas.loop, (char*)&texture);
                 int has_texture = strncmp("NONE", texture, 4);
                 if(has_texture != 0) {
-                    Texture t = LoadTexture(TextFormat("%s/%s", GetDirectoryPath(file), texture));
+                    // emitters sharing an image (by path or contents) share the texture
+                    Texture t = EditorAcquireTexture(TextFormat("%s/%s", GetDirectoryPath(file), texture));
                     if(t.id > 0) {
-                        if(Editor.clipboard == NULL || (Editor.clipboard != NULL && Editor.clipboard->config.atlas.texture.id != e->config.atlas.texture.id)) 
-                            UnloadTexture(e->config.atlas.texture);
+                        EditorReleaseTexture(e->config.atlas.texture);
                         e->config.atlas.texture = t;
                     }
                 }
@@ -853,19 +866,13 @@ int LoadEmitters(const char* file)
         else if(buffer[0] == 'c') 
         {
             // parse configuration
-            int id = MAX_EMITTERS, idx=0, bytes=0;
-            sscanf(buffer, "c  %02d%n", &id, &bytes);
-            if(id < MAX_EMITTERS) 
+            int id = -1, idx=0, bytes=0;
+            sscanf(buffer, "c  %d%n", &id, &bytes);
+            Emitter* e = GetLoadedEmitter(&loaded, id);
+            if(e != NULL) 
             {
-                if(Editor.emitters[id] == NULL) {
-                    // allocate memory for emitter
-                    Editor.emitters[id] = calloc(1, sizeof(Emitter));
-                    if(Editor.emitters[id] == NULL) TraceLog(LOG_FATAL, "EMITTER: Failed to allocate memory");
-                    Editor.statistics.total_mem += sizeof(Emitter);
-                }
-                
                 idx += bytes;
-                EmitterConfig* cfg = &Editor.emitters[id]->config;
+                EmitterConfig* cfg = &e->config;
                 sscanf(&buffer[idx], " %04d %2d %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f", 
                     &cfg->emission, &cfg->pulses, &cfg->size.min, &cfg->size.max, &cfg->angle.min, &cfg->angle.max, &cfg->offset.min, &cfg->offset.max, 
                     &cfg->age.min, &cfg->age.max, &cfg->speed.min, &cfg->speed.max, &cfg->scale.start, &cfg->scale.end, &cfg->acc.start, &cfg->acc.end, 
@@ -875,36 +882,21 @@ int LoadEmitters(const char* file)
         else if(buffer[0] == 'e')
         {
             // parse emitter
-            int id = MAX_EMITTERS, idx = 0, bytes = 0;
-            sscanf(buffer, "e  %02d%n", &id, &bytes);
-            if(id < MAX_EMITTERS) 
+            int id = -1, idx = 0, bytes = 0;
+            sscanf(buffer, "e  %d%n", &id, &bytes);
+            Emitter* e = GetLoadedEmitter(&loaded, id);
+            if(e != NULL) 
             {
-                if(Editor.emitters[id] == NULL) 
-                {
-                    // allocate memory for emitter
-                    Editor.emitters[id] = calloc(1, sizeof(Emitter));
-                    if(Editor.emitters[id] == NULL) TraceLog(LOG_FATAL, "EMITTER: Failed to allocate memory");
-                    Editor.statistics.total_mem += sizeof(Emitter);
-                }
-                
-                if(Editor.emitters[id]->config.forces.data == NULL) {
-                    Editor.emitters[id]->config.forces.data = calloc(MAX_FORCES, sizeof(Force));
-                    Editor.statistics.total_mem += MAX_FORCES*sizeof(Force);
-                }
-                
-                Emitter* e = Editor.emitters[id];
-                int eidx = 0;
+                int eidx = 0, max_particles = 0, sort = EMITTER_SORT_SPAWN_TIME; // older files don't have the sort and priority fields
+                e->priority = 0.0f;
                 idx += bytes;
-                sscanf(&buffer[idx], " %f %f %04d %f %f %02d %04d %d %02d %f %f", &e->position.x, &e->position.y, &e->particles.max, &e->life, &e->delay, (int*)&e->mode, &eidx, &e->flags, 
-                    (int*)&e->config.container.type, &e->config.container.opt1, &e->config.container.opt2);
-                e->particles.max = MAX_PARTICLES;
-                // make sure we allocate memory for the particles
-                if(e->particles.data == NULL) {
-                    e->particles.data = calloc(MAX_PARTICLES, sizeof(Particle));
-                    Editor.statistics.total_mem += MAX_PARTICLES*sizeof(Particle);
-                }
+                sscanf(&buffer[idx], " %f %f %04d %f %f %02d %04d %d %02d %f %f %d %f", &e->position.x, &e->position.y, &max_particles, &e->life, &e->delay, (int*)&e->mode, &eidx, &e->flags, 
+                    (int*)&e->config.container.type, &e->config.container.opt1, &e->config.container.opt2, &sort, &e->priority);
+                e->config.sort = (sort >= EMITTER_SORT_NONE && sort <= EMITTER_SORT_DEPTH) ? sort : EMITTER_SORT_SPAWN_TIME;
+                e->particles.limit = (max_particles > 0) ? max_particles : MAX_PARTICLES;
                 if(eidx < SIZEOF(Easings)) e->config.easing = Easings[eidx];
-                Editor.emitter_count += 1;
+                EditorFitEmitter(e); // size the particles from the configuration
+                loaded.complete[id] = true;
             }
         } 
         else if(buffer[0] == 'n') 
@@ -932,5 +924,14 @@ int LoadEmitters(const char* file)
     }
     fclose(fp);
     
+    // add the emitters in the order of their ids (the ones missing the `e` line are dropped)
+    for(int id=0; id<loaded.count; ++id) {
+        if(loaded.emitters[id] == NULL) continue;
+        if(loaded.complete[id]) EditorInsertEmitter(loaded.emitters[id]);
+        else EditorFreeEmitter(loaded.emitters[id]);
+    }
+    free(loaded.emitters);
+    free(loaded.complete);
+    
     return 1;
 }
@@ -6,6 +6,17 @@
     Make sure to #define LIB_RAY_PARTICLES_IMPL in exactly one source file to
     include the implementation.
     
+    #define PARTICLES_COMPACT (in every source file that includes this header)
+    to store only 24 bytes per particle, everything else is derived from a 
+    per particle seed when needed (trades memory for some extra math).
+    
+    The simulation itself (`EmitterUpdateDt()`) doesn't need a raylib window,
+    it only uses the time step and random state passed to it.
+    
+    #define PARTICLES_THREADS (in every source file that includes this header)
+    to get a pthreads worker pool that updates many emitters in parallel 
+    (see `ParticlesPoolCreate()`, link with -pthread).
+    
     So far i haven't decided on a stable API so only 2 functions are exposed
     =========================================================================
     LICENSE: zlib
@@ -18,16 +29,31 @@
 
 #include <raylib.h>
 #include <raymath.h>
+#include <rlgl.h>
 #include <easings.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 
 #include <math.h>
 
+#if defined(PARTICLES_THREADS)
+    #include <pthread.h>
+    #include <unistd.h>
+#endif
+
+// Batch update kernels using SSE2/AVX2 (selected at runtime), #define PARTICLES_NO_SIMD to use only the scalar code
+#if !defined(PARTICLES_COMPACT) && !defined(PARTICLES_NO_SIMD) && (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    #define PARTICLES_SIMD_X86
+    #include <immintrin.h>
+#endif
+
 #define FLAG_SET(n, f) ((n) |= (f))
 #define FLAG_CLEAR(n, f) ((n) &= ~(f))
 #define FLAG_TOGGLE(n, f) ((n) ^= (f))
 #define FLAG_CHECK(n, f) ((n) & (f))
 
+// A single particle (only used when spawning, the emitter stores its particles as a structure of arrays, see `Emitter.particles`)
 typedef struct {
     Vector2 origin;             // Position of the particle when spawned
     Vector2 direction;          // Direction vector normalized
@@ -38,16 +64,44 @@ typedef struct {
     float life;                 // Total life
     float angle;                // Starting angle (information is stored in the directional vector but needed by EMITTER_FLAG_DIRECTIONAL_ROTATION)
     int tidx;                   // Index in a multitexture (used only when EMITTER_FLAG_MULTITEXTURE is set)
-    
-    // FIXME: the struct is getting way too big (3*8 + 6*4 = 48 bytes)
-    // think of a way to make it smaller while still retaining all the fields
-    // maybe calculate the direction each frame (since we already have the angle) 
-    // and just use a random seed when spawned and calculate (mostly) everything from that seed, something like below
-    // struct { Vector2 origin, position; float time; int seed; } Particle; // (2*8+2*4 = 24 bytes, much better)
+    unsigned int seed;          // Seed used to generate the random attributes of the particle
 } Particle;
 
+// Every particle array is aligned to this (a cache line)
+#define PARTICLES_ALIGNMENT 64
+
+// Number of bytes each particle needs for sorting (key, order and scratch space for the radix sort). Allocated separately on the 
+// first sort, see `EmitterFreeExtraArrays()`
+#define PARTICLE_SORT_BYTES (2*sizeof(unsigned short) + 2*sizeof(unsigned int))
+
+// Number of bytes each particle needs for interpolation (the position before the last fixed step). Allocated separately on the 
+// first update with a `ParticlesClock`, see `EmitterFreeExtraArrays()`
+#define PARTICLE_PREVIOUS_BYTES sizeof(Vector2)
+
+// Number of bytes each particle needs in the emitter arrays
+#if defined(PARTICLES_COMPACT)
+    #define PARTICLE_BYTES (2*sizeof(Vector2) + sizeof(float) + sizeof(unsigned int))
+#else
+    #define PARTICLE_BYTES (3*sizeof(Vector2) + 5*sizeof(float) + sizeof(int))
+#endif
+
 typedef float (*Easing)(float, float, float, float);
 
+// Number of colors in the baked gradient table of each emitter
+#if !defined(PARTICLES_GRADIENT_LUT_SIZE)
+    #define PARTICLES_GRADIENT_LUT_SIZE 256
+#endif
+
+// Random number generator state (xoshiro128**), seed it with `RngSeed()`
+typedef struct {
+    uint32_t s[4];
+} RngState;
+
+// Number of samples in the baked easing table of each emitter
+#if !defined(PARTICLES_EASING_LUT_SIZE)
+    #define PARTICLES_EASING_LUT_SIZE 256
+#endif
+
 typedef enum {
     EMITTER_POINT = 0,
     EMITTER_RECT,
@@ -56,11 +110,19 @@ typedef enum {
     //TODO: add an EMITTER_ELIPSE and maybe EMITTER_TRI
 } EmitterType;
 
+// Order used to draw the particles (sorted again every frame, see `EmitterBuildVertices()`)
+typedef enum {
+    EMITTER_SORT_NONE = 0,          // No sorting, the order is undefined (particles are moved around when others die)
+    EMITTER_SORT_SPAWN_TIME,        // Oldest particles first, the newest end up on top
+    EMITTER_SORT_REMAINING_LIFE,    // Particles about to die first
+    EMITTER_SORT_DEPTH,             // Top to bottom (by the y position)
+} EmitterSort;
+
 typedef enum {
     EMITTER_FLAG_DISABLED = 1 << 0,                 // Is the emitter disabled (default is false)
     EMITTER_FLAG_PAUSED = 1 << 1,                   // Is the emitter currently paused? (default is false)
     EMITTER_FLAG_SPAWN_INSIDE = 1 << 2,             // Spawn particles inside or outside container (default outside) (used for everything except EMITTER_POINT)
-    EMITTER_FLAG_REVERSE_DRAW_ORDER = 1 << 3,       // Draw particles new -> old or old -> new(default)
+    EMITTER_FLAG_REVERSE_DRAW_ORDER = 1 << 3,       // Draw particles in the reverse of the `config.sort` order (new -> old with EMITTER_SORT_SPAWN_TIME, still undefined with EMITTER_SORT_NONE)
     EMITTER_FLAG_WORLD_SPACE = 1 << 4,              // Particle has origin in local space or world space(default)
     EMITTER_FLAG_DRAW_TRIANGLES = 1 << 5,           // When no texture is present draw triangles or squares(default)
     EMITTER_FLAG_DRAW_OUTLINE = 1 << 6,             // When no texture is present draw outlines instead of filled shapes(default)
@@ -102,6 +164,8 @@ typedef struct {
         Texture2D texture;      // Main texture
         int hframes, vframes;   // How many horizontal/vertical frames there are (or multitextures when EMITTER_FLAG_MULTITEXTURE is set)
         int loop;               // How many times to loop the animation (1 -> n)
+        Texture2D page;         // Atlas page holding a copy of `texture`, drawn instead of it when set (see `ParticlesPackAtlas()`)
+        Rectangle source;       // Area of `page` with the copy (in pixels)
     } atlas;
     
     struct {
@@ -110,6 +174,7 @@ typedef struct {
     } gradient;             // Color gradient that will be applied to all particles over time
     
     Easing easing;          // Easing used when updating particles each frame
+    EmitterSort sort;       // Draw order (ignored by the order independent blend modes)
     
     struct {
         EmitterType type;   // Type of the emitter container
@@ -126,38 +191,217 @@ typedef struct {
     EmitterConfig config;   // Main configuration for the emitter
     
     struct {
-        Particle* data;     // Array of particles for this emitter (shouldn't be NULL)
-        int count;          // Number of particles that are alive
-        int max;            // Max capacity of the array
-    } particles;
+        void* data;         // Memory block holding all the arrays below (shouldn't be NULL, see `EmitterAllocateParticles()`)
+        
+        // hot data (touched by every update)
+        Vector2* position;  // Current position
+        float* time;        // Curent particle age
+    #if defined(PARTICLES_COMPACT)
+        unsigned int* seed; // Seed the rest of the attributes are derived from
+    #else
+        Vector2* direction; // Direction vector normalized
+        float* life;        // Total life
+        float* speed;       // Initial speed
+    #endif
+        
+        // cold data (touched when spawning, drawing or by tangential acceleration)
+        Vector2* origin;    // Position of the particle when spawned
+    #if !defined(PARTICLES_COMPACT)
+        float* size;        // Initial size
+        float* angle;       // Starting angle
+        int* tidx;          // Index in a multitexture
+    #endif
+        
+        // interpolation (not part of `data`, allocated on the first update with a clock and freed by an update without one)
+        Vector2* previous;  // Position before the last fixed step (used to interpolate when drawing)
+        int previous_max;   // Capacity of `previous`
+        
+        // draw order (not part of `data`, allocated on the first sort when `config.sort` is set)
+        unsigned short* sort_key; // Quantized sort key of each particle (and scratch space for the radix sort)
+        unsigned int* order;      // Particle indices sorted by key (and scratch space for the radix sort)
+        int sort_max;             // Capacity of the sort arrays
+        
+        int count;          // Number of particles that are alive (alive particles are always packed at the start of the arrays)
+        int max;            // Max capacity of the arrays
+        int limit;          // Most particles the arrays can grow to (0 means no limit, see `EmitterWantedCapacity()`)
+    } particles;            // Particles stored as a structure of arrays (each array has `max` elements)
     
     float life;             // Life of the emitter in seconds
     float delay;            // How long to wait until the emitter emits particles after it is dead (only if EMITTER_FLAG_LOOP is set)
     BlendMode mode;         // Emitter blend mode (currently only the raylib blend modes are supported)
     int flags;
+    float priority;         // How much of the emission is kept when over the frame budget, 0 (default) scales fully and 1 is never scaled (see `ParticlesBudget`)
     
     // PRIVATE MEMBERS - SHOULDN'T  BE CHANGED BY THE USER
     float spawn_timer;      // Time since last spawned particle
     float emit_timer;       // Time since emitting particles
+    int demand;             // Most particles spawning wanted alive since the last `EmitterWantedCapacity()`
+    int low_checks;         // Consecutive `EmitterWantedCapacity()` calls the particles used less than a quarter of the capacity
+    float throttle;         // Fraction of `config.emission` taken away by the frame budget (see `ParticlesBudgetUpdate()`)
+    RngState rng;           // Random state used for new particles (seeded on first use if never seeded, see `EmitterSeed()`)
+    Vector2 bounds_min;     // Box around the particle positions after the last update, empty (min > max) when there are none 
+                            // (see `EmitterGetBounds()`)
+    Vector2 bounds_max;
+    Easing baked_easing;    // Easing `easing_lut` was baked from
+    float easing_lut[PARTICLES_EASING_LUT_SIZE+1]; // Normalized `config.easing` sampled over [0,1]
+    float easing_min;       // Smallest value in `easing_lut` (some easings overshoot)
+    float easing_max;       // Biggest value in `easing_lut`
+    unsigned int gradient_hash; // Hash of the gradient (and easing) `gradient_lut` was baked from
+    Color gradient_lut[PARTICLES_GRADIENT_LUT_SIZE]; // `config.gradient` sampled over the life of a particle
     
 } Emitter;
 
+// A corner of a particle quad (see `EmitterBuildVertices()`)
+typedef struct {
+    float x, y;                     // Position
+    float u, v;                     // Texture coordinates (normalized)
+    Color color;
+} ParticleVertex;
+
+// Number of `EmitterWantedCapacity()` calls the particles have to stay under a quarter of the capacity before it shrinks
+#if !defined(PARTICLES_SHRINK_DELAY)
+    #define PARTICLES_SHRINK_DELAY 120
+#endif
+
+// Number of particles `EmitterDraw()` builds at a time (on the stack)
+#if !defined(PARTICLES_DRAW_BATCH)
+    #define PARTICLES_DRAW_BATCH 256
+#endif
+
+// Clock used to update emitters with a fixed time step (see `ParticlesClockAdvance()`)
+typedef struct {
+    float step;                     // Duration of a step in seconds (1.0f/rate)
+    int max_steps;                  // Max steps per frame, the rest of the time is dropped so a slow frame can't stall the next ones (0 means 8)
+    float accumulator;              // Time not yet simulated
+    int steps;                      // Number of steps to run this frame (the same for every emitter)
+    float alpha;                    // How far we are between the previous and the current step (used to interpolate when drawing)
+} ParticlesClock;
+
+// Clock used to measure how long the particles take (override it to run without a raylib window)
+#if !defined(PARTICLES_GET_TIME)
+    #define PARTICLES_GET_TIME() GetTime()
+#endif
+
+// Keeps the time spent updating and drawing particles under a budget by scaling down the emission of the emitters (see `ParticlesBudgetUpdate()`)
+typedef struct {
+    float budget;                   // Seconds per frame the particles can take (0 disables the governor)
+    float min_scale;                // Lowest scale allowed (0 means 0.1)
+    float scale;                    // Scale applied to the emission and cap of the emitters (1 when under budget)
+    float cost;                     // Smoothed seconds per frame spent on the particles
+    float elapsed;                  // Seconds measured so far this frame
+    double start;                   // Time the last measurement started
+} ParticlesBudget;
+
+#if defined(PARTICLES_THREADS)
+// Persistent worker threads used to update emitters in parallel
+typedef struct ParticlesPool ParticlesPool;
+
+// Number of particles each worker moves at a time (a multiple of 16 so every chunk starts on a cache line in every array)
+#if !defined(PARTICLES_CHUNK_SIZE)
+    #define PARTICLES_CHUNK_SIZE 2048
+#endif
+#if PARTICLES_CHUNK_SIZE <= 0 || PARTICLES_CHUNK_SIZE % 16 != 0
+    #error "PARTICLES_CHUNK_SIZE must be a positive multiple of 16"
+#endif
+#endif
+
 // Extra params used when drawing the emitter
 typedef struct {
     Rectangle* screen;              // If not null particles will drawn only if inside this screen area (used to cull particles)
+    ParticlesClock* clock;          // If not null particle positions are interpolated between the last two fixed steps
+    int next;                       // Next particle (in draw order) `EmitterBuildVertices()` starts from, set to 0 to start over
     int drawn;                      // Number of particles drawned each frame
     unsigned long long pixels;      // Number of pixels drawn each frame
+    bool keep_blend_mode;           // Leave the blend mode set after drawing so the next emitter with the same mode (and texture or 
+                                    // atlas page) continues the same batch. Call `EndBlendMode()` after the last emitter
 } EmitterExtraParams;
 
+// Transparent pixels left around every texture packed in an atlas page (so filtering doesn't pick up the neighbours)
+#if !defined(PARTICLES_ATLAS_PADDING)
+    #define PARTICLES_ATLAS_PADDING 2
+#endif
+
 
-// Update emitter `e`. should be called before `EmitterDraw()`
+// Get the size in bytes of the memory block needed to hold `max` particles
+extern size_t ParticlesMemorySize(int max);
+// Use `memory` (at least `ParticlesMemorySize(max)` bytes, zero initialized) to store the particles of emitter `e`
+extern void EmitterSetParticleMemory(Emitter* e, void* memory, int max);
+// Allocate memory for `max` particles. Returns false on failure
+extern bool EmitterAllocateParticles(Emitter* e, int max);
+// Free the memory allocated with `EmitterAllocateParticles()` (and the extra arrays)
+extern void EmitterFreeParticles(Emitter* e);
+// Free the arrays that aren't part of the particle memory (allocated on first use: the previous positions and the sort arrays).
+// Call it before freeing memory given to `EmitterSetParticleMemory()`
+extern void EmitterFreeExtraArrays(Emitter* e);
+// Kill all the particles of emitter `e`
+extern void EmitterResetParticles(Emitter* e);
+// Move the alive particles of emitter `e` to `memory` (at least `ParticlesMemorySize(max)` bytes, zero initialized), keeping at 
+// most `max` of them. The old memory isn't freed
+extern void EmitterMoveParticles(Emitter* e, void* memory, int max);
+// Estimate how many particles emitter `e` has alive at once from its emission, pulses, life and age
+extern int EmitterCapacityHint(const Emitter* e);
+// Get the capacity emitter `e` should have (at most `particles.limit`). It grows as soon as spawning runs out of room or the hint 
+// goes over it, and shrinks (never below `EmitterCapacityHint()`) only after the particles used less than a quarter of it for 
+// PARTICLES_SHRINK_DELAY calls. Call once per frame and move the particles if it changed
+extern int EmitterWantedCapacity(Emitter* e);
+// Update emitter `e` by the frame time. should be called before `EmitterDraw()`
 extern int EmitterUpdate(Emitter* e);
+// Update emitter `e` by `dt` seconds using `rng` for new particles (NULL uses the emitter's own state). Returns the number of particles updated
+extern int EmitterUpdateDt(Emitter* e, float dt, RngState* rng);
+// Get a clock that steps `rate` times per second
+extern ParticlesClock ParticlesClockCreate(int rate);
+// Add `frame_time` seconds to `clock` and work out how many fixed steps to run this frame. Call once per frame
+extern void ParticlesClockAdvance(ParticlesClock* clock, float frame_time);
+// Update emitter `e` by the steps `clock` has for this frame. Returns the number of particles updated over all the steps
+extern int EmitterUpdateFixed(Emitter* e, const ParticlesClock* clock, RngState* rng);
+// Get a governor that keeps the particles under `budget` seconds per frame
+extern ParticlesBudget ParticlesBudgetCreate(float budget);
+// Start measuring the time spent on particles (can be called many times per frame, for example around updating and around drawing)
+extern void ParticlesBudgetBegin(ParticlesBudget* budget);
+// Stop measuring the time spent on particles
+extern void ParticlesBudgetEnd(ParticlesBudget* budget);
+// Adjust the scale from the time measured this frame and apply it to `count` emitters by their priority. Call once per frame
+extern void ParticlesBudgetUpdate(ParticlesBudget* budget, Emitter** emitters, int count);
+#if defined(PARTICLES_THREADS)
+// Start `threads` workers (0 uses one per core). Returns NULL on failure
+extern ParticlesPool* ParticlesPoolCreate(int threads);
+// Stop the workers and free `pool`
+extern void ParticlesPoolDestroy(ParticlesPool* pool);
+// Update `count` emitters in parallel by `dt` seconds (or by the steps of `clock` if not NULL) and wait for all of them to finish.
+// Big emitters are split into chunks of PARTICLES_CHUNK_SIZE particles. Every emitter uses its own random state. Returns the number of particles updated
+extern int ParticlesPoolUpdate(ParticlesPool* pool, Emitter** emitters, int count, float dt, const ParticlesClock* clock);
+#endif
+// Get the box that holds every particle of emitter `e` as drawn (empty when there are no particles). Valid after an update
+extern Rectangle EmitterGetBounds(Emitter* e);
+// Fill `out` with up to `capacity` vertices of the quads of emitter `e` that are visible, starting from particle `params->next` and 
+// updating it (so call it again if all the particles didn't fit). Every quad is 4 vertices clockwise from the top left 
+// (triangles 0,1,2 and 0,2,3). Doesn't call raylib so it can run on any thread. Returns the number of vertices written
+extern int EmitterBuildVertices(Emitter* e, EmitterExtraParams* params, ParticleVertex* out, int capacity);
 // Draw emitter `e` using some extra params. Should be called after `EmitterUpdate()`
 extern void EmitterDraw(Emitter* e, EmitterExtraParams* params);
+// Copy the textures of `count` emitters in atlas pages of `size`x`size` pixels so emitters drawn one after the other with the 
+// same blend mode bind the same texture. Emitters with the same texture share its copy and textures that don't fit in `max_pages` 
+// are left unpacked. Reads the textures back from the GPU so call it once after loading (not every frame). Returns the number of 
+// pages written to `pages`
+extern int ParticlesPackAtlas(Emitter** emitters, int count, int size, Texture2D* pages, int max_pages);
+// Unload the pages made by `ParticlesPackAtlas()` and draw the emitters with their own textures again
+extern void ParticlesUnpackAtlas(Emitter** emitters, int count, Texture2D* pages, int page_count);
+// Get the area of the world visible through `camera` on a `width`x`height` screen (use it as `EmitterExtraParams.screen`)
+extern Rectangle GetCameraViewRect(Camera2D camera, float width, float height);
 // Get a random float between 0.0 and 1.0
 extern float GetRandomFloat();
 // Get a random float between min and max
 extern float GetRandomFloatBetween(float min, float max);
+// Seed `rng`, the same seed always gives the same sequence
+extern void RngSeed(RngState* rng, uint64_t seed);
+// Get the next random 32 bit value from `rng`
+extern uint32_t RngNext(RngState* rng);
+// Get a random float between 0.0 (inclusive) and 1.0 (exclusive) from `rng`
+extern float RngFloat(RngState* rng);
+// Fill `out` with `n` random floats between 0.0 and 1.0 (advances `rng` only once so the loop can be vectorized)
+extern void RngFloats(RngState* rng, float* out, int n);
+// Seed the random state of emitter `e` so it always spawns the same particles
+extern void EmitterSeed(Emitter* e, uint64_t seed);
 
 
 
@@ -177,6 +421,347 @@ inline float GetRandomFloatBetween(float min, float max) {
     return min + (max - min)*GetRandomFloat();
 }
 
+void RngSeed(RngState* rng, uint64_t seed) {
+    // expand the seed with splitmix64 so similar seeds give unrelated states (and the state is never all zeros)
+    for(int i=0; i<2; ++i) {
+        uint64_t z = (seed += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30))*0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27))*0x94D049BB133111EBull;
+        z ^= z >> 31;
+        rng->s[2*i] = (uint32_t)z;
+        rng->s[2*i+1] = (uint32_t)(z >> 32);
+    }
+}
+
+static inline uint32_t RngRotl(uint32_t x, int k) {
+    return (x << k) | (x >> (32 - k));
+}
+
+uint32_t RngNext(RngState* rng) {
+    uint32_t* s = rng->s;
+    const uint32_t result = RngRotl(s[1]*5, 7)*9;
+    const uint32_t t = s[1] << 9;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = RngRotl(s[3], 11);
+    return result;
+}
+
+float RngFloat(RngState* rng) {
+    return (float)(RngNext(rng) >> 8)*(1.0f/16777216.0f);
+}
+
+// Counter based hash (murmur3 finalizer) of `seed` and `counter`
+static inline uint32_t RngHash(uint32_t seed, uint32_t counter) {
+    uint32_t x = seed ^ (counter*0x9E3779B9u);
+    x ^= x >> 16;
+    x *= 0x85EBCA6Bu;
+    x ^= x >> 13;
+    x *= 0xC2B2AE35u;
+    x ^= x >> 16;
+    return x;
+}
+
+void RngFloats(RngState* rng, float* out, int n) {
+    // every value only depends on its index so there's no dependency between iterations
+    const uint32_t key = RngNext(rng);
+    for(int i=0; i<n; ++i) 
+        out[i] = (float)(RngHash(key, (uint32_t)i) >> 8)*(1.0f/16777216.0f);
+}
+
+void EmitterSeed(Emitter* e, uint64_t seed) {
+    RngSeed(&e->rng, seed);
+}
+
+// Get the random state of emitter `e`, seeding it from raylib if it was never seeded
+static RngState* EmitterRng(Emitter* e) {
+    RngState* rng = &e->rng;
+    if((rng->s[0] | rng->s[1] | rng->s[2] | rng->s[3]) == 0) // an all zero state never changes (and we can't get one from `RngSeed()`)
+        RngSeed(rng, ((uint64_t)GetRandomValue(0, RAND_MAX) << 32) | (uint64_t)GetRandomValue(0, RAND_MAX));
+    return rng;
+}
+
+// Round `size` up to a multiple of PARTICLES_ALIGNMENT
+static inline uintptr_t ParticlesAlign(uintptr_t size) {
+    return (size + PARTICLES_ALIGNMENT - 1) & ~(uintptr_t)(PARTICLES_ALIGNMENT - 1);
+}
+
+size_t ParticlesMemorySize(int max) {
+    const size_t n = (size_t)max;
+    // each array starts on a cache line plus some extra space so we can align the start of the block
+#if defined(PARTICLES_COMPACT)
+    return 2*ParticlesAlign(n*sizeof(Vector2)) + ParticlesAlign(n*sizeof(float)) + ParticlesAlign(n*sizeof(unsigned int)) + PARTICLES_ALIGNMENT;
+#else
+    return 3*ParticlesAlign(n*sizeof(Vector2)) + 5*ParticlesAlign(n*sizeof(float)) + ParticlesAlign(n*sizeof(int)) + PARTICLES_ALIGNMENT;
+#endif
+}
+
+void EmitterSetParticleMemory(Emitter* e, void* memory, int max) {
+    const size_t n = (size_t)max;
+    unsigned char* ptr = (unsigned char*)(uintptr_t)ParticlesAlign((uintptr_t)memory);
+    
+    e->particles.data = memory;
+    e->particles.position = (Vector2*)ptr;  ptr += ParticlesAlign(n*sizeof(Vector2));
+    e->particles.time = (float*)ptr;        ptr += ParticlesAlign(n*sizeof(float));
+#if defined(PARTICLES_COMPACT)
+    e->particles.seed = (unsigned int*)ptr; ptr += ParticlesAlign(n*sizeof(unsigned int));
+    e->particles.origin = (Vector2*)ptr;
+#else
+    e->particles.direction = (Vector2*)ptr; ptr += ParticlesAlign(n*sizeof(Vector2));
+    e->particles.life = (float*)ptr;        ptr += ParticlesAlign(n*sizeof(float));
+    e->particles.speed = (float*)ptr;       ptr += ParticlesAlign(n*sizeof(float));
+    e->particles.origin = (Vector2*)ptr;    ptr += ParticlesAlign(n*sizeof(Vector2));
+    e->particles.size = (float*)ptr;        ptr += ParticlesAlign(n*sizeof(float));
+    e->particles.angle = (float*)ptr;       ptr += ParticlesAlign(n*sizeof(float));
+    e->particles.tidx = (int*)ptr;
+#endif
+    e->particles.max = max;
+    e->particles.count = 0;
+    e->bounds_min = (Vector2){ INFINITY, INFINITY }; // no particles so the box is empty
+    e->bounds_max = (Vector2){ -INFINITY, -INFINITY };
+}
+
+bool EmitterAllocateParticles(Emitter* e, int max) {
+    void* memory = calloc(1, ParticlesMemorySize(max));
+    if(memory == NULL) return false;
+    EmitterSetParticleMemory(e, memory, max);
+    return true;
+}
+
+static void EmitterFreePrevious(Emitter* e) {
+    free(e->particles.previous);
+    e->particles.previous = NULL;
+    e->particles.previous_max = 0;
+}
+
+static void EmitterFreeSortArrays(Emitter* e) {
+    free(e->particles.sort_key);
+    free(e->particles.order);
+    e->particles.sort_key = NULL;
+    e->particles.order = NULL;
+    e->particles.sort_max = 0;
+}
+
+void EmitterFreeExtraArrays(Emitter* e) {
+    EmitterFreePrevious(e);
+    EmitterFreeSortArrays(e);
+}
+
+void EmitterFreeParticles(Emitter* e) {
+    EmitterFreeExtraArrays(e);
+    free(e->particles.data);
+    memset(&e->particles, 0, sizeof(e->particles));
+}
+
+void EmitterResetParticles(Emitter* e) {
+    // only the first `count` particles are alive so this is all we need to clear
+    e->particles.count = 0;
+    e->bounds_min = (Vector2){ INFINITY, INFINITY };
+    e->bounds_max = (Vector2){ -INFINITY, -INFINITY };
+}
+
+void EmitterMoveParticles(Emitter* e, void* memory, int max) {
+    Emitter from;
+    from.particles = e->particles;
+    from.bounds_min = e->bounds_min;
+    from.bounds_max = e->bounds_max;
+    const int count = (from.particles.count < max) ? from.particles.count : max;
+    EmitterSetParticleMemory(e, memory, max);
+    e->bounds_min = from.bounds_min; // the particles that are kept are still inside the old box
+    e->bounds_max = from.bounds_max;
+    
+    // the extra arrays aren't part of the block (the particles keep their indices so `previous` stays valid, and the sort arrays
+    // are rebuilt every frame) and grow the next time they are used
+    #define PARTICLE_MOVE_FIELD(F) memcpy(e->particles.F, from.particles.F, count*sizeof(*e->particles.F))
+    PARTICLE_MOVE_FIELD(position);
+    PARTICLE_MOVE_FIELD(time);
+    PARTICLE_MOVE_FIELD(origin);
+#if defined(PARTICLES_COMPACT)
+    PARTICLE_MOVE_FIELD(seed);
+#else
+    PARTICLE_MOVE_FIELD(direction);
+    PARTICLE_MOVE_FIELD(life);
+    PARTICLE_MOVE_FIELD(speed);
+    PARTICLE_MOVE_FIELD(size);
+    PARTICLE_MOVE_FIELD(angle);
+    PARTICLE_MOVE_FIELD(tidx);
+#endif
+    #undef PARTICLE_MOVE_FIELD
+    e->particles.count = count;
+}
+
+int EmitterCapacityHint(const Emitter* e) {
+    const int emission = e->config.emission;
+    if(emission <= 0 || e->life <= 0.0f) return 0;
+    
+    const float age = fmaxf(e->config.age.min, e->config.age.max);
+    float alive = emission*age/e->life; // spawned per second times how long they live
+    if(e->config.pulses > 0) {
+        // every pulse spawns a whole batch at once
+        const float interval = e->life/e->config.pulses;
+        alive = (float)(emission/e->config.pulses)*ceilf(age/interval);
+    }
+    
+    // leave some room since spawning isn't perfectly even (the emission is the most that can be alive anyway)
+    const int hint = (int)ceilf(alive*1.25f) + 1;
+    return (hint < emission) ? hint : emission;
+}
+
+int EmitterWantedCapacity(Emitter* e) 
+{
+    const int max = e->particles.max;
+    const int peak = (e->demand > e->particles.count) ? e->demand : e->particles.count;
+    const int hint = EmitterCapacityHint(e);
+    e->demand = 0;
+    
+    int wanted = max;
+    if(max == 0 || peak > max || hint > max) 
+    {
+        // grow at once (at least by half so it doesn't grow every frame). Growing to the hint before spawning keeps a restarted 
+        // burst (or one that was just made bigger) from losing the particles that don't fit
+        wanted = (hint > peak) ? hint : peak;
+        if(wanted < max + max/2) wanted = max + max/2;
+        e->low_checks = 0;
+    }
+    else if(peak < max/4) 
+    {
+        // shrink only after staying low for a while so it doesn't bounce around (never below the hint since a burst that 
+        // already ended would be cut short when it starts again)
+        if(++e->low_checks >= PARTICLES_SHRINK_DELAY) {
+            wanted = (2*peak > hint) ? 2*peak : hint;
+            e->low_checks = 0;
+        }
+    }
+    else e->low_checks = 0;
+    
+    // round up so every array keeps starting on a cache line, then apply the limit
+    if(wanted != max) wanted = (wanted < 16) ? 16 : (wanted + 15) & ~15;
+    if(e->particles.limit > 0 && wanted > e->particles.limit) wanted = e->particles.limit;
+    return wanted;
+}
+
+// What each random number derived from the particle seed is used for (the counter passed to `ParticleRandom()`)
+enum {
+    PARTICLE_RANDOM_OFFSET_X = 0,
+    PARTICLE_RANDOM_OFFSET_Y,
+    PARTICLE_RANDOM_ANGLE,
+    PARTICLE_RANDOM_TIDX,
+    PARTICLE_RANDOM_SIDE,           // Ring side to spawn on
+    PARTICLE_RANDOM_SPAWN_X,        // Position inside the container (also used as the distance from center for circles/rings)
+    PARTICLE_RANDOM_SPAWN_Y,
+    PARTICLE_RANDOM_SIZE,
+    PARTICLE_RANDOM_SPEED,
+    PARTICLE_RANDOM_LIFE,
+};
+
+// Counter based hash of `seed` and `counter` mapped to a float between 0.0 and 1.0
+static inline float ParticleRandom(unsigned int seed, unsigned int counter) {
+    return (float)(RngHash(seed, counter) >> 8)*(1.0f/16777216.0f);
+}
+
+static inline float ParticleRandomBetween(unsigned int seed, unsigned int counter, float min, float max) {
+    return min + (max - min)*ParticleRandom(seed, counter);
+}
+
+// Does the particle spawn on the inner side of a ring (its direction is reversed)
+static inline bool ParticleSeedInner(const Emitter* e, unsigned int seed) {
+    return e->config.container.type == EMITTER_RING && !FLAG_CHECK(e->flags, EMITTER_FLAG_SPAWN_INSIDE) && 
+        ParticleRandom(seed, PARTICLE_RANDOM_SIDE) < 0.5f;
+}
+
+static inline float ParticleSeedAngle(const Emitter* e, unsigned int seed) {
+    const float angle = ParticleRandomBetween(seed, PARTICLE_RANDOM_ANGLE, e->config.angle.min, e->config.angle.max);
+    return ParticleSeedInner(e, seed) ? -angle : angle;
+}
+
+static inline Vector2 ParticleSeedDirection(const Emitter* e, unsigned int seed) {
+    const float angle = ParticleRandomBetween(seed, PARTICLE_RANDOM_ANGLE, e->config.angle.min, e->config.angle.max)*DEG2RAD;
+    const float c = cosf(angle), s = sinf(angle);
+    
+    switch(e->config.container.type) 
+    {
+        case EMITTER_RECT: return Vector2Normalize((Vector2){e->config.container.opt1*c, e->config.container.opt2*s});
+        case EMITTER_CIRCLE: return Vector2Normalize((Vector2){e->config.container.opt1*c, e->config.container.opt1*s});
+        case EMITTER_RING: {
+            const float rb = fmaxf(e->config.container.opt1, e->config.container.opt2);
+            const Vector2 direction = Vector2Normalize((Vector2){rb*c, rb*s});
+            return ParticleSeedInner(e, seed) ? Vector2Negate(direction) : direction;
+        }
+        default: return Vector2Normalize((Vector2){c, s});
+    }
+}
+
+static inline float ParticleSeedSize(const Emitter* e, unsigned int seed) {
+    return ParticleRandomBetween(seed, PARTICLE_RANDOM_SIZE, e->config.size.min, e->config.size.max);
+}
+
+static inline float ParticleSeedSpeed(const Emitter* e, unsigned int seed) {
+    return ParticleRandomBetween(seed, PARTICLE_RANDOM_SPEED, e->config.speed.min, e->config.speed.max);
+}
+
+static inline float ParticleSeedLife(const Emitter* e, unsigned int seed) {
+    return ParticleRandomBetween(seed, PARTICLE_RANDOM_LIFE, e->config.age.min, e->config.age.max);
+}
+
+static inline int ParticleSeedTextureIndex(const Emitter* e, unsigned int seed) {
+    const int frames = e->config.atlas.hframes*e->config.atlas.vframes;
+    return (frames > 1) ? (int)(ParticleRandom(seed, PARTICLE_RANDOM_TIDX)*frames) : 0;
+}
+
+// Particle attribute getters (read from the arrays or derived from the seed when PARTICLES_COMPACT is defined)
+#if defined(PARTICLES_COMPACT)
+static inline Vector2 ParticleDirection(const Emitter* e, int i) { return ParticleSeedDirection(e, e->particles.seed[i]); }
+static inline float ParticleLife(const Emitter* e, int i) { return ParticleSeedLife(e, e->particles.seed[i]); }
+static inline float ParticleSpeed(const Emitter* e, int i) { return ParticleSeedSpeed(e, e->particles.seed[i]); }
+static inline float ParticleSize(const Emitter* e, int i) { return ParticleSeedSize(e, e->particles.seed[i]); }
+static inline float ParticleAngle(const Emitter* e, int i) { return ParticleSeedAngle(e, e->particles.seed[i]); }
+static inline int ParticleTextureIndex(const Emitter* e, int i) { return ParticleSeedTextureIndex(e, e->particles.seed[i]); }
+#else
+static inline Vector2 ParticleDirection(const Emitter* e, int i) { return e->particles.direction[i]; }
+static inline float ParticleLife(const Emitter* e, int i) { return e->particles.life[i]; }
+static inline float ParticleSpeed(const Emitter* e, int i) { return e->particles.speed[i]; }
+static inline float ParticleSize(const Emitter* e, int i) { return e->particles.size[i]; }
+static inline float ParticleAngle(const Emitter* e, int i) { return e->particles.angle[i]; }
+static inline int ParticleTextureIndex(const Emitter* e, int i) { return e->particles.tidx[i]; }
+#endif
+
+// Store particle `p` at index `i`
+static inline void ParticleStore(Emitter* e, int i, const Particle* p) {
+    e->particles.position[i] = p->position;
+    e->particles.time[i] = p->time;
+    e->particles.origin[i] = p->origin;
+#if defined(PARTICLES_COMPACT)
+    e->particles.seed[i] = p->seed;
+#else
+    e->particles.direction[i] = p->direction;
+    e->particles.life[i] = p->life;
+    e->particles.speed[i] = p->speed;
+    e->particles.size[i] = p->size;
+    e->particles.angle[i] = p->angle;
+    e->particles.tidx[i] = p->tidx;
+#endif
+}
+
+// Copy particle at index `src` over the particle at index `dst`
+static inline void ParticleCopy(Emitter* e, int dst, int src) {
+    e->particles.position[dst] = e->particles.position[src];
+    e->particles.time[dst] = e->particles.time[src];
+    e->particles.origin[dst] = e->particles.origin[src];
+#if defined(PARTICLES_COMPACT)
+    e->particles.seed[dst] = e->particles.seed[src];
+#else
+    e->particles.direction[dst] = e->particles.direction[src];
+    e->particles.life[dst] = e->particles.life[src];
+    e->particles.speed[dst] = e->particles.speed[src];
+    e->particles.size[dst] = e->particles.size[src];
+    e->particles.angle[dst] = e->particles.angle[src];
+    e->particles.tidx[dst] = e->particles.tidx[src];
+#endif
+}
+
 // Rotates point `p` `a` degrees around origin `o`
 static inline Vector2 RotatePointOnCircle(Vector2 o, Vector2 p, float a) {
     const float ra = a*DEG2RAD;
@@ -185,47 +770,71 @@ static inline Vector2 RotatePointOnCircle(Vector2 o, Vector2 p, float a) {
     return (Vector2){o.x + (p.x-o.x)*c - (p.y-o.y)*s, o.y + (p.x-o.x)*s + (p.y-o.y)*c };
 }
 
-static inline void ParticleUpdate(Emitter* e, Particle* p) {
-    float dt = GetFrameTime();
-    if(dt == 0.0f) dt = 0.0016f;
-    
-    const Easing easing = e->config.easing;
+// Bake the easing of emitter `e` into its lookup table if it changed since the last time
+static inline void EmitterBakeEasing(Emitter* e) {
+    if(e->baked_easing == e->config.easing) return;
+    e->easing_min = e->easing_max = 0.0f;
+    for(int k=0; k<=PARTICLES_EASING_LUT_SIZE; ++k) {
+        e->easing_lut[k] = e->config.easing((float)k/PARTICLES_EASING_LUT_SIZE, 0.0f, 1.0f, 1.0f);
+        e->easing_min = fminf(e->easing_min, e->easing_lut[k]);
+        e->easing_max = fmaxf(e->easing_max, e->easing_lut[k]);
+    }
+    e->baked_easing = e->config.easing;
+}
+
+// Same as `e->config.easing(time, start, end-start, duration)` but using the baked lookup table
+static inline float EmitterEase(const Emitter* e, float time, float start, float end, float duration) {
+    float t = (duration > 0.0f) ? time/duration*PARTICLES_EASING_LUT_SIZE : PARTICLES_EASING_LUT_SIZE;
+    t = Clamp(t, 0.0f, PARTICLES_EASING_LUT_SIZE);
+    const int k = (t < PARTICLES_EASING_LUT_SIZE) ? (int)t : PARTICLES_EASING_LUT_SIZE-1;
+    const float v = e->easing_lut[k] + (e->easing_lut[k+1] - e->easing_lut[k])*(t - k);
+    return start + (end - start)*v;
+}
+
+// Update particle `i` by `dt` seconds, `forces` is the displacement caused by the emitter forces (see `EmitterForces()`)
+static inline void ParticleUpdate(Emitter* e, int i, float dt, Vector2 forces) {
+    const float time = e->particles.time[i];
+    const float life = ParticleLife(e, i);
+    const Vector2 position = e->particles.position[i];
     
     // calculate speed and acceleration
-    const float speed = (p->speed + easing(p->time, e->config.acc.start, e->config.acc.end - e->config.acc.start, p->life))*dt;
-    Vector2 npos = Vector2Add(p->position, Vector2Scale(p->direction, speed));
+    const float speed = (ParticleSpeed(e, i) + EmitterEase(e, time, e->config.acc.start, e->config.acc.end, life))*dt;
+    Vector2 npos = Vector2Add(position, Vector2Scale(ParticleDirection(e, i), speed));
     
     // calculate tangential acceleration
-    const float tacc = easing(p->time, e->config.tacc.start, e->config.tacc.end - e->config.tacc.start, p->life)*dt;
+    const float tacc = EmitterEase(e, time, e->config.tacc.start, e->config.tacc.end, life)*dt;
     if(tacc != 0.0f) {
-        Vector2 n = Vector2Subtract(npos, p->origin);
+        const Vector2 origin = e->particles.origin[i];
+        Vector2 n = Vector2Subtract(npos, origin);
         float angle = 90.0f;
         if(tacc < 0.0f) {
-            n = Vector2Subtract(p->origin, npos);
+            n = Vector2Subtract(origin, npos);
             angle = -90.0f;
         }
         
         n = Vector2Normalize(n);
         //#define MIN_RADIUS 20.0f
-        //Vector2 t = Vector2Add(npos, Vector2Scale(n, tacc*(Vector2Distance(npos, p->origin)/MIN_RADIUS) ));
+        //Vector2 t = Vector2Add(npos, Vector2Scale(n, tacc*(Vector2Distance(npos, origin)/MIN_RADIUS) ));
         // FIXME: `tacc` needs to depend on the distance to origin (larger distance -> bigger effect)
         Vector2 t = Vector2Add(npos, Vector2Scale(n, tacc));
-        p->position = RotatePointOnCircle(npos, t, angle);
+        npos = RotatePointOnCircle(npos, t, angle);
     }
-    else p->position = npos;
     
-    // TODO: just adding the forces together..hmmm, is this correct?!
+    e->particles.position[i] = Vector2Add(npos, forces);
+    e->particles.time[i] = time + dt;
+}
+
+// Get the displacement caused by all the forces of emitter `e` in `dt` seconds (the same for every particle)
+static inline Vector2 EmitterForces(const Emitter* e, float dt) {
+    // TODO: just adding the forces together..hmm, is this correct?!
     Vector2 forces = {0.0f, 0.0f};
-    for(int i=0; i<e->config.forces.count; ++i) {
-        Force* f = &e->config.forces.data[i];
-        const float angle = f->direction*DEG2RAD;
-        Vector2 direction = Vector2Normalize((Vector2){cosf(angle), sinf(angle)});
-        forces = Vector2Add(forces, Vector2Scale(direction, f->strength*dt));
+    for(int f=0; f<e->config.forces.count; ++f) {
+        const Force* force = &e->config.forces.data[f];
+        const float angle = force->direction*DEG2RAD;
+        forces.x += cosf(angle)*force->strength*dt;
+        forces.y += sinf(angle)*force->strength*dt;
     }
-    
-    p->position = Vector2Add(p->position, forces);
-    
-    p->time += dt;
+    return forces;
 }
 
 // Keep angle between 0-360
@@ -240,23 +849,24 @@ static inline int GetQuadrant(float angle) {
 	return (int)fmodf(NormalizeAngle(angle)/45.0f, 8.0);
 }
 
-static Particle ParticleGenerate(Emitter* e) {
-    Particle p;
+// Generate a new particle, all the random attributes are derived from `seed`
+static Particle ParticleGenerate(Emitter* e, unsigned int seed) {
+    Particle p = {0};
+    p.seed = seed;
     
-    // Get offset and angle
-    const Vector2 offset = {GetRandomFloatBetween(e->config.offset.min, e->config.offset.max), 
-        GetRandomFloatBetween(e->config.offset.min, e->config.offset.max)};
-    p.angle = GetRandomFloatBetween(e->config.angle.min, e->config.angle.max);
-    const float angle = p.angle*DEG2RAD;
+    // Get offset, angle and direction
+    const Vector2 offset = {ParticleRandomBetween(seed, PARTICLE_RANDOM_OFFSET_X, e->config.offset.min, e->config.offset.max), 
+        ParticleRandomBetween(seed, PARTICLE_RANDOM_OFFSET_Y, e->config.offset.min, e->config.offset.max)};
+    p.angle = ParticleSeedAngle(e, seed);
+    p.direction = ParticleSeedDirection(e, seed);
     
     // Generate a random multitexture index if EMITTER_FLAG_MULTITEXTURE is set
-    if(e->config.atlas.hframes*e->config.atlas.vframes > 1) p.tidx = GetRandomValue(0, e->config.atlas.hframes*e->config.atlas.vframes-1);
+    p.tidx = ParticleSeedTextureIndex(e, seed);
     
     switch(e->config.container.type) 
     {
         case EMITTER_POINT:
             p.origin = offset;
-            p.direction = Vector2Normalize((Vector2){cosf(angle), sinf(angle)});
         break;
         
         case EMITTER_RECT: {
@@ -265,7 +875,7 @@ static Particle ParticleGenerate(Emitter* e) {
             
             if(!FLAG_CHECK(e->flags, EMITTER_FLAG_SPAWN_INSIDE)) {
                 // spawn outside the rectangle (is there a better way to do this?!?)
-                const float a = angle*RAD2DEG;
+                const float a = p.angle;
                 const int q = GetQuadrant(a); // divide the rectangle in 8(0-7) quadrants 45degrees each
                 const float pc = fmodf(NormalizeAngle(a), 45.0f) / 45.0f; // calculate percent of the side to fill
                 // calculate x/y coordinates for each quadrant
@@ -276,10 +886,9 @@ static Particle ParticleGenerate(Emitter* e) {
                 p.origin.y = qh[q];
             } else {
                 // randomly spawn inside the rectangle
-                p.origin.x = GetRandomValue(-width/2, width/2);
-                p.origin.y = GetRandomValue(-height/2, height/2);
+                p.origin.x = ParticleRandomBetween(seed, PARTICLE_RANDOM_SPAWN_X, -width/2, width/2);
+                p.origin.y = ParticleRandomBetween(seed, PARTICLE_RANDOM_SPAWN_Y, -height/2, height/2);
             }
-            p.direction = Vector2Normalize((Vector2){width*cosf(angle), height*sinf(angle)});
             p.origin = Vector2Add(p.origin, offset);
         }
         break;
@@ -287,9 +896,8 @@ static Particle ParticleGenerate(Emitter* e) {
         case EMITTER_CIRCLE: 
         {
             const float r = e->config.container.opt1;
-            p.direction = Vector2Normalize((Vector2){r*cosf(angle), r*sinf(angle)});
             if(!FLAG_CHECK(e->flags, EMITTER_FLAG_SPAWN_INSIDE)) p.origin = Vector2Scale(p.direction, r); // spawn outside the circle
-            else p.origin = Vector2Scale(p.direction, GetRandomFloatBetween(0.0f, r)); // spawn inside circle
+            else p.origin = Vector2Scale(p.direction, ParticleRandomBetween(seed, PARTICLE_RANDOM_SPAWN_X, 0.0f, r)); // spawn inside circle
             p.origin = Vector2Add(p.origin, offset);
         }
         break;
@@ -305,18 +913,13 @@ static Particle ParticleGenerate(Emitter* e) {
                 rb = tmp;
             }
             
-            p.direction = Vector2Normalize((Vector2){rb*cosf(angle), rb*sinf(angle)});
             if(!FLAG_CHECK(e->flags, EMITTER_FLAG_SPAWN_INSIDE)) {
-                const float rnd = GetRandomFloat(); // get a random float to see where should we spawn
-                if(rnd >= 0.5f)
+                if(!ParticleSeedInner(e, seed))
                     p.origin = Vector2Scale(p.direction, rb); // spawn outside outer ring
-                else { 
-                    p.origin = Vector2Scale(p.direction, ra); // spawn inside inner ring
-                    p.direction = Vector2Negate(p.direction); // inverse direction
-                    p.angle *= -1.0f;
-                }
+                else 
+                    p.origin = Vector2Scale(p.direction, -ra); // spawn inside inner ring (the direction is already reversed)
             } else {
-                p.origin = Vector2Scale(p.direction, GetRandomFloatBetween(ra, rb)); // spawn inbetween rings
+                p.origin = Vector2Scale(p.direction, ParticleRandomBetween(seed, PARTICLE_RANDOM_SPAWN_X, ra, rb)); // spawn inbetween rings
             }
              p.origin = Vector2Add(p.origin, offset);
         }
@@ -330,323 +933,1063 @@ static Particle ParticleGenerate(Emitter* e) {
     p.position = p.origin;
     
     // Calculate initial particle size and speed
-    p.size = GetRandomFloatBetween(e->config.size.min, e->config.size.max);
-    p.speed = GetRandomFloatBetween(e->config.speed.min, e->config.speed.max);
+    p.size = ParticleSeedSize(e, seed);
+    p.speed = ParticleSeedSpeed(e, seed);
     
     // Calculate particle life
-    p.life = GetRandomFloatBetween(e->config.age.min, e->config.age.max); 
+    p.life = ParticleSeedLife(e, seed); 
     p.time = 0.0f;
     
     return p;
 }
 
-int EmitterUpdate(Emitter* e) {
+// Is `easing` a linear easing (sampled at a few points since the raylib easings are static functions)
+static inline bool EasingIsLinear(Easing easing) {
+    return easing(0.25f, 0.0f, 1.0f, 1.0f) == 0.25f && easing(0.75f, 0.0f, 1.0f, 1.0f) == 0.75f;
+}
+
+// Parameters shared by all the particles in a batch update
+typedef struct {
+    float dt;
+    float acc_start, acc_delta; // linear acceleration `acc_start + acc_delta*time/life`
+    Vector2 forces;             // displacement caused by all the forces this frame
+} ParticleBatch;
+
+typedef void (*ParticleBatchKernel)(Emitter* e, int start, int end, const ParticleBatch* b);
+
+#if !defined(PARTICLES_COMPACT)
+// Update particles [start, end) with no tangential acceleration and linear (or constant) acceleration
+static void ParticlesUpdateBatchScalar(Emitter* e, int start, int end, const ParticleBatch* b) {
+    for(int i=start; i<end; ++i) {
+        const float time = e->particles.time[i];
+        const float speed = (e->particles.speed[i] + (b->acc_delta*time/e->particles.life[i] + b->acc_start))*b->dt;
+        const Vector2 npos = Vector2Add(e->particles.position[i], Vector2Scale(e->particles.direction[i], speed));
+        e->particles.position[i] = Vector2Add(npos, b->forces);
+        e->particles.time[i] = time + b->dt;
+    }
+}
+#endif
+
+#if defined(PARTICLES_SIMD_X86)
+// Same as `ParticlesUpdateBatchScalar()` but 4 particles at a time
+__attribute__((target("sse2")))
+static void ParticlesUpdateBatchSSE2(Emitter* e, int start, int end, const ParticleBatch* b) {
+    float* position = (float*)e->particles.position;
+    const float* direction = (const float*)e->particles.direction;
+    const __m128 dt = _mm_set1_ps(b->dt);
+    const __m128 acc_start = _mm_set1_ps(b->acc_start);
+    const __m128 acc_delta = _mm_set1_ps(b->acc_delta);
+    const __m128 forces = _mm_setr_ps(b->forces.x, b->forces.y, b->forces.x, b->forces.y);
+    
+    int i = start;
+    for(; i+4<=end; i+=4) {
+        const __m128 time = _mm_loadu_ps(&e->particles.time[i]);
+        const __m128 acc = _mm_add_ps(_mm_div_ps(_mm_mul_ps(acc_delta, time), _mm_loadu_ps(&e->particles.life[i])), acc_start);
+        const __m128 speed = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(&e->particles.speed[i]), acc), dt);
+        
+        // positions are interleaved (x,y) so duplicate the speeds to match them
+        const __m128 s01 = _mm_unpacklo_ps(speed, speed);
+        const __m128 s23 = _mm_unpackhi_ps(speed, speed);
+        
+        __m128 p01 = _mm_loadu_ps(&position[2*i]);
+        __m128 p23 = _mm_loadu_ps(&position[2*i+4]);
+        p01 = _mm_add_ps(_mm_add_ps(p01, _mm_mul_ps(_mm_loadu_ps(&direction[2*i]), s01)), forces);
+        p23 = _mm_add_ps(_mm_add_ps(p23, _mm_mul_ps(_mm_loadu_ps(&direction[2*i+4]), s23)), forces);
+        _mm_storeu_ps(&position[2*i], p01);
+        _mm_storeu_ps(&position[2*i+4], p23);
+        _mm_storeu_ps(&e->particles.time[i], _mm_add_ps(time, dt));
+    }
+    
+    ParticlesUpdateBatchScalar(e, i, end, b);
+}
+
+// Same as `ParticlesUpdateBatchScalar()` but 8 particles at a time
+__attribute__((target("avx2")))
+static void ParticlesUpdateBatchAVX2(Emitter* e, int start, int end, const ParticleBatch* b) {
+    float* position = (float*)e->particles.position;
+    const float* direction = (const float*)e->particles.direction;
+    const __m256 dt = _mm256_set1_ps(b->dt);
+    const __m256 acc_start = _mm256_set1_ps(b->acc_start);
+    const __m256 acc_delta = _mm256_set1_ps(b->acc_delta);
+    const __m256 forces = _mm256_setr_ps(b->forces.x, b->forces.y, b->forces.x, b->forces.y, b->forces.x, b->forces.y, b->forces.x, b->forces.y);
+    
+    int i = start;
+    for(; i+8<=end; i+=8) {
+        const __m256 time = _mm256_loadu_ps(&e->particles.time[i]);
+        const __m256 acc = _mm256_add_ps(_mm256_div_ps(_mm256_mul_ps(acc_delta, time), _mm256_loadu_ps(&e->particles.life[i])), acc_start);
+        const __m256 speed = _mm256_mul_ps(_mm256_add_ps(_mm256_loadu_ps(&e->particles.speed[i]), acc), dt);
+        
+        // positions are interleaved (x,y) so duplicate the speeds to match them (unpack works on each 128 bit lane)
+        const __m256 lo = _mm256_unpacklo_ps(speed, speed); // s0 s0 s1 s1 | s4 s4 s5 s5
+        const __m256 hi = _mm256_unpackhi_ps(speed, speed); // s2 s2 s3 s3 | s6 s6 s7 s7
+        const __m256 s0123 = _mm256_permute2f128_ps(lo, hi, 0x20);
+        const __m256 s4567 = _mm256_permute2f128_ps(lo, hi, 0x31);
+        
+        __m256 p0123 = _mm256_loadu_ps(&position[2*i]);
+        __m256 p4567 = _mm256_loadu_ps(&position[2*i+8]);
+        p0123 = _mm256_add_ps(_mm256_add_ps(p0123, _mm256_mul_ps(_mm256_loadu_ps(&direction[2*i]), s0123)), forces);
+        p4567 = _mm256_add_ps(_mm256_add_ps(p4567, _mm256_mul_ps(_mm256_loadu_ps(&direction[2*i+8]), s4567)), forces);
+        _mm256_storeu_ps(&position[2*i], p0123);
+        _mm256_storeu_ps(&position[2*i+8], p4567);
+        _mm256_storeu_ps(&e->particles.time[i], _mm256_add_ps(time, dt));
+    }
+    
+    ParticlesUpdateBatchSSE2(e, i, end, b);
+}
+#endif
+
+// Get the fastest batch kernel supported by this CPU
+static ParticleBatchKernel ParticlesGetBatchKernel() {
+#if defined(PARTICLES_SIMD_X86)
+    static ParticleBatchKernel kernel = NULL;
+    if(kernel == NULL) {
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx2")) kernel = &ParticlesUpdateBatchAVX2;
+        else if(__builtin_cpu_supports("sse2")) kernel = &ParticlesUpdateBatchSSE2;
+        else kernel = &ParticlesUpdateBatchScalar;
+    }
+    return kernel;
+#elif !defined(PARTICLES_COMPACT)
+    return &ParticlesUpdateBatchScalar;
+#else
+    return NULL; // the compact layout has no direction/speed/life arrays to batch over
+#endif
+}
+
+// Spawn `n` new particles (or as many as there is room for). Returns the number of particles spawned
+static int ParticlesSpawn(Emitter* e, int n, RngState* rng) {
+    // the free slots are always [count, max) so taking `n` of them is just bumping the count
+    const int first = e->particles.count;
+    if(n > e->particles.max - first) n = e->particles.max - first;
+    if(n <= 0) return 0;
+    
+    // one draw from `rng` per batch, each particle seed is a hash of it and the particle index
+    const uint32_t key = RngNext(rng);
+    for(int i=first; i<first+n; ++i) {
+        const Particle p = ParticleGenerate(e, RngHash(key, (uint32_t)i));
+        ParticleStore(e, i, &p);
+    }
+    e->particles.count = first + n;
+    
+    return n;
+}
+
+// Max number of particles alive (and the emission rate) after the frame budget scaled it down
+static inline int EmitterEmission(const Emitter* e) {
+    return (int)(e->config.emission*(1.0f - e->throttle));
+}
+
+// Box around some particle positions
+typedef struct {
+    Vector2 min, max;
+} ParticleBounds;
+
+static inline ParticleBounds ParticleBoundsEmpty() {
+    return (ParticleBounds){ {INFINITY, INFINITY}, {-INFINITY, -INFINITY} };
+}
+
+static inline ParticleBounds ParticleBoundsMerge(ParticleBounds a, ParticleBounds b) {
+    return (ParticleBounds){ {fminf(a.min.x, b.min.x), fminf(a.min.y, b.min.y)}, {fmaxf(a.max.x, b.max.x), fmaxf(a.max.y, b.max.y)} };
+}
+
+// Get the box around the positions of particles [start, end) of emitter `e`
+static ParticleBounds ParticlesBounds(const Emitter* e, int start, int end) {
+    ParticleBounds b = ParticleBoundsEmpty();
+    const Vector2* position = e->particles.position;
+    for(int i=start; i<end; ++i) {
+        b.min.x = (position[i].x < b.min.x) ? position[i].x : b.min.x;
+        b.min.y = (position[i].y < b.min.y) ? position[i].y : b.min.y;
+        b.max.x = (position[i].x > b.max.x) ? position[i].x : b.max.x;
+        b.max.y = (position[i].y > b.max.y) ? position[i].y : b.max.y;
+    }
+    return b;
+}
+
+// What moving the particles of an emitter by one step needs (worked out once per step by `EmitterStepBegin()`)
+typedef struct {
+    int count;                      // Number of particles to move
+    bool keep_previous;             // The positions before this step were saved (the bounds need to hold them too)
+    ParticleBounds previous;        // Box around the positions before this step (only set when `keep_previous` is)
+    float dt;
+    Vector2 forces;
+    ParticleBatchKernel kernel;     // NULL when the particles need the full `ParticleUpdate()`
+    ParticleBatch batch;
+} ParticleMove;
+
+// Save the positions before a step for interpolation, (re)allocating `particles.previous` when it's too small. Returns false on failure
+static bool EmitterKeepPrevious(Emitter* e) {
+    if(e->particles.previous_max < e->particles.max)
+    {
+        // the old positions are overwritten below so there is nothing to keep
+        EmitterFreePrevious(e);
+        e->particles.previous = (Vector2*)malloc((size_t)e->particles.max*sizeof(Vector2));
+        if(e->particles.previous == NULL) return false;
+        e->particles.previous_max = e->particles.max;
+    }
+    memcpy(e->particles.previous, e->particles.position, e->particles.count*sizeof(Vector2));
+    return true;
+}
+
+// First part of a step: spawn and remove particles and work out how to move the rest. Returns false if the emitter shouldn't be updated
+static bool EmitterStepBegin(Emitter* e, float dt, RngState* rng, bool keep_previous, ParticleMove* move) {
+    move->count = 0;
     if(FLAG_CHECK(e->flags, EMITTER_FLAG_DISABLED) || FLAG_CHECK(e->flags, EMITTER_FLAG_PAUSED)) 
-        return 0; // don't update when paused or disabled
+        return false; // don't update when paused or disabled
     
     // Emit particles
-    if(e->particles.count < e->config.emission && e->life != 0.0f && e->emit_timer > e->delay && e->emit_timer < e->delay + e->life) 
+    const int emission = EmitterEmission(e);
+    if(e->particles.count < emission && e->life != 0.0f && e->emit_timer > e->delay && e->emit_timer < e->delay + e->life) 
     {
         const float duration = e->life;
-        const float dt = GetFrameTime();
         
         // FIXME: hmmm... this is wrong!!! not all the particles are emitted.
         float tick = dt;
-        int rate = (float)e->config.emission/duration*dt;
+        int rate = (float)emission/duration*dt;
         
         if(e->config.pulses != 0) {
-            rate = e->config.emission/e->config.pulses; // rate per pulse
+            rate = emission/e->config.pulses; // rate per pulse
             tick = duration/e->config.pulses; // time of each pulse
         }
         
         if(e->particles.count == 0) tick = e->spawn_timer;
         
-        if(rate + e->particles.count > e->config.emission) rate = e->config.emission - e->particles.count;
+        if(rate + e->particles.count > emission) rate = emission - e->particles.count;
         if(e->spawn_timer >= tick) 
         {
             e->spawn_timer -= tick;
-            for(int i=0, r=0; i<e->particles.max; ++i) {
-                if(e->particles.data[i].life == 0.0f) {
-                    e->particles.data[i] = ParticleGenerate(e);
-                    e->particles.count += 1;
-                    if(++r >= rate) break;
-                }
-            }
+            if(e->particles.count + rate > e->demand) e->demand = e->particles.count + rate; // room spawning wanted (see `EmitterWantedCapacity()`)
+            ParticlesSpawn(e, rate, rng);
         }
         e->spawn_timer += dt;
     }
     
-    // Update particles
-    int updated = 0;
-    for(int i=0; i<e->particles.max && e->particles.count > 0; ++i) {
-        if(e->particles.data[i].life != 0.0f) {
-            if(e->particles.data[i].time >= e->particles.data[i].life) {
-                // remove particle
-                e->particles.count -= 1;
-                if(e->particles.count < 0 ) e->particles.count = 0;
-                e->particles.data[i].life = 0.0f;
-            } else {
-                ParticleUpdate(e, &e->particles.data[i]);
-                if(i > 0 && e->particles.data[i-1].life > e->particles.data[i].life) 
-                {
-                    // overtime swapping values like this will autosort the particle array (over time)
-                    Particle tmp = e->particles.data[i];
-                    e->particles.data[i] = e->particles.data[i-1];
-                    e->particles.data[i-1] = tmp;
-                }
-                ++updated;
-            }
-        }
+    // Remove dead particles
+    for(int i=0; i<e->particles.count; ) {
+        if(e->particles.time[i] >= ParticleLife(e, i)) {
+            // remove particle by moving the last alive particle in its place (and check that one next)
+            e->particles.count -= 1;
+            ParticleCopy(e, i, e->particles.count);
+        } else ++i;
+    }
+    
+    // Prepare the update of the particles that are left (without the previous positions drawing just doesn't interpolate)
+    if(keep_previous) keep_previous = EmitterKeepPrevious(e);
+    if(keep_previous) move->previous = ParticlesBounds(e, 0, e->particles.count);
+    EmitterBakeEasing(e);
+    move->count = e->particles.count;
+    move->keep_previous = keep_previous;
+    move->dt = dt;
+    move->forces = EmitterForces(e, dt); // forces are the same for all particles so only calculate them once
+    move->kernel = NULL;
+    
+    const ParticleBatchKernel kernel = ParticlesGetBatchKernel();
+    const bool linear = (e->config.acc.start == e->config.acc.end) || EasingIsLinear(e->config.easing);
+    if(kernel != NULL && linear && e->config.tacc.start == 0.0f && e->config.tacc.end == 0.0f) 
+    {
+        // no tangential acceleration and linear (or constant) acceleration so we can update all the particles in one batch
+        move->kernel = kernel;
+        move->batch = (ParticleBatch){ dt, e->config.acc.start, e->config.acc.end - e->config.acc.start, move->forces };
     }
+    return true;
+}
+
+// Move particles [start, end) of emitter `e` and return the box around them. Every particle only depends on itself so any split 
+// of the range gives the same result
+static ParticleBounds EmitterStepMove(Emitter* e, const ParticleMove* move, int start, int end) {
+    if(move->kernel != NULL) move->kernel(e, start, end, &move->batch);
+    else for(int i=start; i<end; ++i) ParticleUpdate(e, i, move->dt, move->forces);
+    return ParticlesBounds(e, start, end); // the positions were just written so they are still in the cache
+}
+
+// Last part of a step: store the box around the particles and advance the emitter timers
+static void EmitterStepEnd(Emitter* e, float dt, const ParticleMove* move, ParticleBounds bounds) {
+    if(move->keep_previous) {
+        // drawing interpolates from the previous positions so the box has to hold them too (only the ones of this step, the 
+        // stored box was merged with the steps before it)
+        bounds = ParticleBoundsMerge(bounds, move->previous);
+    }
+    e->bounds_min = bounds.min;
+    e->bounds_max = bounds.max;
     
     // Handle emitting in a loop
     if(FLAG_CHECK(e->flags, EMITTER_FLAG_LOOP)) 
     {
         if(e->emit_timer > 2*e->delay + e->life) { e->emit_timer = e->delay; }
-        else { e->emit_timer += GetFrameTime(); }
+        else { e->emit_timer += dt; }
     }
     else 
     {
         if(e->emit_timer < 2*e->delay + e->life) 
-            e->emit_timer += GetFrameTime();
+            e->emit_timer += dt;
+    }
+}
+
+// Advance emitter `e` by `dt` seconds. When `keep_previous` is set the positions before this step are saved for interpolation
+static int EmitterStep(Emitter* e, float dt, RngState* rng, bool keep_previous) {
+    ParticleMove move;
+    if(!EmitterStepBegin(e, dt, rng, keep_previous, &move)) return 0;
+    const ParticleBounds bounds = EmitterStepMove(e, &move, 0, move.count);
+    EmitterStepEnd(e, dt, &move, bounds);
+    return move.count;
+}
+
+int EmitterUpdate(Emitter* e) {
+    return EmitterUpdateDt(e, GetFrameTime(), NULL);
+}
+
+int EmitterUpdateDt(Emitter* e, float dt, RngState* rng) {
+    EmitterFreePrevious(e); // not drawn with a clock so there is nothing to interpolate
+    return EmitterStep(e, dt, (rng != NULL) ? rng : EmitterRng(e), false);
+}
+
+ParticlesClock ParticlesClockCreate(int rate) {
+    ParticlesClock clock = {0};
+    clock.step = 1.0f/(rate > 0 ? rate : 60);
+    return clock;
+}
+
+void ParticlesClockAdvance(ParticlesClock* clock, float frame_time) {
+    const int max_steps = (clock->max_steps > 0) ? clock->max_steps : 8;
+    clock->accumulator += frame_time;
+    clock->steps = (int)(clock->accumulator/clock->step);
+    if(clock->steps > max_steps) {
+        // we can't catch up so drop the extra time instead of simulating it in later frames
+        clock->steps = max_steps;
+        clock->accumulator = max_steps*clock->step;
+    }
+    clock->accumulator -= clock->steps*clock->step;
+    clock->alpha = Clamp(clock->accumulator/clock->step, 0.0f, 1.0f);
+}
+
+int EmitterUpdateFixed(Emitter* e, const ParticlesClock* clock, RngState* rng) {
+    if(rng == NULL) rng = EmitterRng(e);
+    int updated = 0;
+    for(int s=0; s<clock->steps; ++s) 
+        updated += EmitterStep(e, clock->step, rng, s == clock->steps-1); // only the state before the last step is needed for interpolation
+    return updated;
+}
+
+ParticlesBudget ParticlesBudgetCreate(float budget) {
+    return (ParticlesBudget){ .budget = budget, .min_scale = 0.1f, .scale = 1.0f };
+}
+
+void ParticlesBudgetBegin(ParticlesBudget* budget) {
+    budget->start = PARTICLES_GET_TIME();
+}
+
+void ParticlesBudgetEnd(ParticlesBudget* budget) {
+    budget->elapsed += (float)(PARTICLES_GET_TIME() - budget->start);
+}
+
+void ParticlesBudgetUpdate(ParticlesBudget* budget, Emitter** emitters, int count) 
+{
+    // smooth the cost so a single slow frame doesn't throttle everything
+    budget->cost = (budget->cost > 0.0f) ? budget->cost + (budget->elapsed - budget->cost)*0.25f : budget->elapsed;
+    budget->elapsed = 0.0f;
+    
+    const float min_scale = (budget->min_scale > 0.0f) ? budget->min_scale : 0.1f;
+    if(budget->budget <= 0.0f) budget->scale = 1.0f;
+    else if(budget->cost > 0.0f) 
+    {
+        // the cost grows with the number of particles so this is the scale that would hit the budget
+        const float ideal = budget->scale*budget->budget/budget->cost;
+        if(budget->cost > budget->budget) {
+            // the particles already alive take a while to die so don't drop too much at once
+            budget->scale = fmaxf(ideal, budget->scale*0.9f);
+        } 
+        else if(budget->cost < 0.75f*budget->budget) {
+            // restore slowly, leaving some room so it doesn't bounce around the budget
+            budget->scale = fminf(budget->scale + 0.02f, ideal);
+        }
+    }
+    budget->scale = Clamp(budget->scale, min_scale, 1.0f);
+    
+    for(int i=0; i<count; ++i) {
+        const float priority = Clamp(emitters[i]->priority, 0.0f, 1.0f);
+        emitters[i]->throttle = (1.0f - budget->scale)*(1.0f - priority);
+    }
+}
+
+#if defined(PARTICLES_THREADS)
+struct ParticlesPool {
+    pthread_t* threads;
+    int thread_count;
+    
+    pthread_mutex_t lock;
+    pthread_cond_t wake;            // Signaled when a new job is posted (or when quitting)
+    pthread_cond_t done;            // Signaled when the last worker finished the job
+    unsigned int generation;        // Incremented for every job so the workers know there is new work
+    int active;                     // Workers still working on the current job
+    bool quit;
+    
+    // current job (only changed while all the workers are idle)
+    void (*task)(ParticlesPool* pool, int index); // Run for every index in [0, tasks)
+    int tasks;
+    int next;                       // Next task to run (taken atomically)
+    
+    // current update
+    Emitter** emitters;
+    int count;
+    float dt;
+    bool fixed;                     // Updating with a clock (otherwise the previous positions aren't needed)
+    bool keep_previous;
+    ParticleMove* moves;            // One for every emitter
+    int* chunks;                    // Index of the first chunk of every emitter (plus the total number of chunks at the end)
+    int capacity;                   // Number of emitters `moves` and `chunks` have room for
+    ParticleBounds* bounds;         // Box around the particles of every chunk (NULL if it couldn't be allocated)
+    int bounds_capacity;
+};
+
+// Run tasks until there are none left in the current job (runs on the workers and on the calling thread)
+static void ParticlesPoolWork(ParticlesPool* pool) {
+    int i;
+    while((i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED)) < pool->tasks) pool->task(pool, i);
+}
+
+static void* ParticlesPoolWorker(void* arg) {
+    ParticlesPool* pool = arg;
+    unsigned int seen = 0; // the pool is created with generation 0 (a worker can start after the first job is posted)
+    pthread_mutex_lock(&pool->lock);
+    for(;;) {
+        while(pool->generation == seen && !pool->quit) pthread_cond_wait(&pool->wake, &pool->lock);
+        if(pool->quit) break;
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+        
+        ParticlesPoolWork(pool);
+        
+        pthread_mutex_lock(&pool->lock);
+        if(--pool->active == 0) pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+ParticlesPool* ParticlesPoolCreate(int threads) {
+    if(threads <= 0) {
+        // the calling thread also does work so one less than the number of cores
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN) - 1;
+        if(threads < 1) threads = 1;
+    }
+    
+    ParticlesPool* pool = calloc(1, sizeof(ParticlesPool));
+    if(pool == NULL) return NULL;
+    pool->threads = calloc(threads, sizeof(pthread_t));
+    if(pool->threads == NULL) { free(pool); return NULL; }
+    
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    for(int i=0; i<threads; ++i) {
+        if(pthread_create(&pool->threads[i], NULL, &ParticlesPoolWorker, pool) != 0) break;
+        pool->thread_count += 1;
     }
     
+    if(pool->thread_count == 0) {
+        ParticlesPoolDestroy(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+void ParticlesPoolDestroy(ParticlesPool* pool) {
+    if(pool == NULL) return;
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = true;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    for(int i=0; i<pool->thread_count; ++i) pthread_join(pool->threads[i], NULL);
+    
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->moves);
+    free(pool->chunks);
+    free(pool->bounds);
+    free(pool->threads);
+    free(pool);
+}
+
+// Run `task` for every index in [0, tasks) on all the threads and wait for them to finish
+static void ParticlesPoolRun(ParticlesPool* pool, void (*task)(ParticlesPool*, int), int tasks) {
+    if(tasks <= 0) return;
+    
+    pthread_mutex_lock(&pool->lock);
+    pool->task = task;
+    pool->tasks = tasks;
+    pool->next = 0;
+    pool->active = pool->thread_count;
+    pool->generation += 1;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    
+    ParticlesPoolWork(pool);
+    
+    pthread_mutex_lock(&pool->lock);
+    while(pool->active > 0) pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static void ParticlesPoolBeginTask(ParticlesPool* pool, int i) {
+    Emitter* e = pool->emitters[i];
+    if(!pool->fixed) EmitterFreePrevious(e);
+    EmitterStepBegin(e, pool->dt, &e->rng, pool->keep_previous, &pool->moves[i]);
+}
+
+static void ParticlesPoolMoveTask(ParticlesPool* pool, int chunk) {
+    // find the emitter this chunk belongs to
+    int lo = 0, hi = pool->count - 1;
+    while(lo < hi) {
+        const int mid = (lo + hi + 1)/2;
+        if(pool->chunks[mid] <= chunk) lo = mid;
+        else hi = mid - 1;
+    }
+    
+    const ParticleMove* move = &pool->moves[lo];
+    const int start = (chunk - pool->chunks[lo])*PARTICLES_CHUNK_SIZE;
+    const int end = (start + PARTICLES_CHUNK_SIZE < move->count) ? start + PARTICLES_CHUNK_SIZE : move->count;
+    const ParticleBounds bounds = EmitterStepMove(pool->emitters[lo], move, start, end);
+    if(pool->bounds != NULL) pool->bounds[chunk] = bounds;
+}
+
+int ParticlesPoolUpdate(ParticlesPool* pool, Emitter** emitters, int count, float dt, const ParticlesClock* clock) {
+    if(count <= 0) return 0;
+    
+    if(count > pool->capacity) {
+        ParticleMove* moves = realloc(pool->moves, count*sizeof(ParticleMove));
+        if(moves != NULL) pool->moves = moves;
+        int* chunks = realloc(pool->chunks, (count + 1)*sizeof(int));
+        if(chunks != NULL) pool->chunks = chunks;
+        if(moves == NULL || chunks == NULL) {
+            // not enough memory to update in parallel so just update on this thread
+            int updated = 0;
+            for(int i=0; i<count; ++i) 
+                updated += (clock != NULL) ? EmitterUpdateFixed(emitters[i], clock, NULL) : EmitterUpdateDt(emitters[i], dt, NULL);
+            return updated;
+        }
+        pool->capacity = count;
+    }
+    
+    // do everything that touches shared state here so the workers only touch their own emitter
+    ParticlesGetBatchKernel();
+    for(int i=0; i<count; ++i) EmitterRng(emitters[i]);
+    
+    pool->emitters = emitters;
+    pool->count = count;
+    pool->dt = (clock != NULL) ? clock->step : dt;
+    pool->fixed = (clock != NULL);
+    
+    int updated = 0;
+    const int steps = (clock != NULL) ? clock->steps : 1;
+    for(int s=0; s<steps; ++s) 
+    {
+        // spawn and remove particles of every emitter
+        pool->keep_previous = (clock != NULL && s == steps-1);
+        ParticlesPoolRun(pool, &ParticlesPoolBeginTask, count);
+        
+        // split the particles into fixed size chunks (the split doesn't depend on the number of threads so the results are always the same)
+        int chunks = 0;
+        for(int i=0; i<count; ++i) {
+            pool->chunks[i] = chunks;
+            chunks += (pool->moves[i].count + PARTICLES_CHUNK_SIZE - 1)/PARTICLES_CHUNK_SIZE;
+        }
+        pool->chunks[count] = chunks;
+        if(chunks > pool->bounds_capacity) {
+            free(pool->bounds);
+            pool->bounds = malloc(chunks*sizeof(ParticleBounds));
+            pool->bounds_capacity = (pool->bounds != NULL) ? chunks : 0;
+        }
+        ParticlesPoolRun(pool, &ParticlesPoolMoveTask, chunks);
+        
+        for(int i=0; i<count; ++i) {
+            if(FLAG_CHECK(emitters[i]->flags, EMITTER_FLAG_DISABLED) || FLAG_CHECK(emitters[i]->flags, EMITTER_FLAG_PAUSED)) continue;
+            
+            // merge the boxes of the chunks of this emitter (or find it here if there was no memory for them)
+            ParticleBounds bounds = ParticleBoundsEmpty();
+            if(pool->bounds != NULL) {
+                for(int c=pool->chunks[i]; c<pool->chunks[i+1]; ++c) bounds = ParticleBoundsMerge(bounds, pool->bounds[c]);
+            }
+            else bounds = ParticlesBounds(emitters[i], 0, pool->moves[i].count);
+            
+            EmitterStepEnd(emitters[i], pool->dt, &pool->moves[i], bounds);
+            updated += pool->moves[i].count;
+        }
+    }
+    
+    // all the workers are done at this point so the emitters are safe to draw
     return updated;
 }
+#endif // PARTICLES_THREADS
+
+// Position particle `i` should be drawn at (interpolated between the last two fixed steps when drawing with a clock)
+static inline Vector2 ParticleDrawPosition(const Emitter* e, int i, const EmitterExtraParams* params) {
+    if(params->clock == NULL || e->particles.previous == NULL) return e->particles.position[i];
+    return Vector2Lerp(e->particles.previous[i], e->particles.position[i], params->clock->alpha);
+}
 
 static inline Color MixColors(Emitter* e, Color a, Color b, float st, float et) {
-    int cr = e->config.easing(st, a.r, b.r-a.r, et);
+    // all channels use the same easing so only look it up once
+    const float v = EmitterEase(e, st, 0.0f, 1.0f, et);
+    int cr = a.r + (b.r-a.r)*v;
     cr = Clamp(cr, 0, 255);
-    int cg = e->config.easing(st, a.g, b.g-a.g, et);
+    int cg = a.g + (b.g-a.g)*v;
     cg = Clamp(cg, 0, 255);
-    int cb = e->config.easing(st, a.b, b.b-a.b, et);
+    int cb = a.b + (b.b-a.b)*v;
     cb = Clamp(cb, 0, 255);
     
     Color color = {cr, cg, cb, b.a};
     if(b.a != a.a) 
     {
-        int ca = e->config.easing(st, a.a, b.a-a.a, et);
+        int ca = a.a + (b.a-a.a)*v;
         color.a = Clamp(ca, 0, 255);
     }
     
 	return color;
 }
 
-static inline Color Interpolate(Emitter* e, Particle* p) { 
+// Get the color of the gradient of emitter `e` at normalized age `t`
+static inline Color GradientColor(Emitter* e, float t) {
     if(e->config.gradient.colors == NULL || e->config.gradient.count == 0) return RED;
     if(e->config.gradient.count == 1) return e->config.gradient.colors[0]; // no need to interpolate since there's only one color
     
     const int max = e->config.gradient.count - 1;
-    const float u = p->life/max;
-    int idx = 0;
-    idx = floorf(p->time*max/p->life);
+    const int idx = floorf(t*max);
+    if(idx >= max) return e->config.gradient.colors[max]; // at (or past) the end of the gradient
+    
+    return MixColors(e, e->config.gradient.colors[idx], e->config.gradient.colors[idx+1], t*max - idx, 1.0f);
+}
+
+// Bake the gradient of emitter `e` into its color table if the gradient (or easing) changed since the last time. 
+// Needs the easing to be baked first (see `EmitterBakeEasing()`)
+static void EmitterBakeGradient(Emitter* e) {
+    // FNV-1a of everything the table depends on (the colors are edited in place so we can't just compare pointers)
+    unsigned int hash = 2166136261u;
+    #define PARTICLES_HASH_BYTES(P, N) for(size_t b=0; b<(N); ++b) { hash = (hash ^ ((const unsigned char*)(P))[b])*16777619u; }
+    PARTICLES_HASH_BYTES(&e->config.gradient.count, sizeof(e->config.gradient.count));
+    PARTICLES_HASH_BYTES(&e->config.easing, sizeof(e->config.easing));
+    if(e->config.gradient.colors != NULL && e->config.gradient.count > 0) 
+        PARTICLES_HASH_BYTES(e->config.gradient.colors, e->config.gradient.count*sizeof(Color));
+    #undef PARTICLES_HASH_BYTES
+    if(hash == 0) hash = 1; // 0 means never baked
+    if(hash == e->gradient_hash) return;
     
-    float st = fmodf(p->time, u);
-    if(st+GetFrameTime() > u) st = u;
+    for(int k=0; k<PARTICLES_GRADIENT_LUT_SIZE; ++k) 
+        e->gradient_lut[k] = GradientColor(e, (float)k/(PARTICLES_GRADIENT_LUT_SIZE-1));
+    e->gradient_hash = hash;
+}
 
-    return MixColors(e, e->config.gradient.colors[idx], e->config.gradient.colors[idx+1], st, u);
+// Get the color of particle `i` from the baked gradient
+static inline Color Interpolate(const Emitter* e, int i) { 
+    const float life = ParticleLife(e, i);
+    const float t = (life > 0.0f) ? e->particles.time[i]/life : 1.0f;
+    const int k = (int)(Clamp(t, 0.0f, 1.0f)*(PARTICLES_GRADIENT_LUT_SIZE-1) + 0.5f);
+    return e->gradient_lut[k];
 }
 
-void EmitterDraw(Emitter* e, EmitterExtraParams* params) 
+Rectangle GetCameraViewRect(Camera2D camera, float width, float height) {
+    if(camera.zoom <= 0.0f) return (Rectangle){-camera.offset.x, -camera.offset.y, width, height};
+    
+    // screen = offset + zoom*rotate(world - target) so world = target + rotate_back(screen - offset)/zoom
+    const float ra = -camera.rotation*DEG2RAD;
+    const float s = sinf(ra)/camera.zoom, c = cosf(ra)/camera.zoom;
+    const Vector2 corners[4] = { {0.0f, 0.0f}, {width, 0.0f}, {width, height}, {0.0f, height} };
+    
+    Vector2 min = {INFINITY, INFINITY}, max = {-INFINITY, -INFINITY};
+    for(int k=0; k<4; ++k) {
+        // the view is rotated so the visible area is the box around the 4 corners in the world
+        const Vector2 p = Vector2Subtract(corners[k], camera.offset);
+        const Vector2 w = { camera.target.x + p.x*c - p.y*s, camera.target.y + p.x*s + p.y*c };
+        min = (Vector2){ fminf(min.x, w.x), fminf(min.y, w.y) };
+        max = (Vector2){ fmaxf(max.x, w.x), fmaxf(max.y, w.y) };
+    }
+    return (Rectangle){ min.x, min.y, max.x - min.x, max.y - min.y };
+}
+
+// Is point `p` inside rectangle `r` (same as raylib's `CheckCollisionPointRec()`)
+static inline bool ParticlePointInRect(Vector2 p, Rectangle r) {
+    return p.x >= r.x && p.x <= r.x + r.width && p.y >= r.y && p.y <= r.y + r.height;
+}
+
+// Write a quad to `out`, `v` are the corners clockwise from the top left and `uv` the normalized texture region
+static inline void ParticleWriteQuad(ParticleVertex* out, const Vector2* v, Rectangle uv, Color color) {
+    out[0] = (ParticleVertex){ v[0].x, v[0].y, uv.x, uv.y, color };
+    out[1] = (ParticleVertex){ v[1].x, v[1].y, uv.x + uv.width, uv.y, color };
+    out[2] = (ParticleVertex){ v[2].x, v[2].y, uv.x + uv.width, uv.y + uv.height, color };
+    out[3] = (ParticleVertex){ v[3].x, v[3].y, uv.x, uv.y + uv.height, color };
+}
+
+// Draw order is sorted only when blending depends on it (adding or multiplying colors gives the same result in any order)
+static inline bool EmitterNeedsSort(const Emitter* e) {
+    return e->config.sort != EMITTER_SORT_NONE && e->mode != BLEND_ADDITIVE && e->mode != BLEND_ADD_COLORS && e->mode != BLEND_MULTIPLIED;
+}
+
+// Quantize `v` from [0, range] to a 16 bit sort key
+static inline unsigned short ParticleSortKey(float v, float range) {
+    const float k = (range > 0.0f) ? v/range*65535.0f : 0.0f;
+    return (unsigned short)Clamp(k, 0.0f, 65535.0f);
+}
+
+// Fill `particles.order` with the alive particles sorted by `config.sort` (a stable 2 pass LSD radix sort over 16 bit keys). 
+// The sort arrays are (re)allocated when they are smaller than the particle arrays. Returns false when that fails
+static bool EmitterSortParticles(Emitter* e, const EmitterExtraParams* params) 
 {
-    // NOTE: this code has been (somewhat) optimised but still slow :(
-    if(!FLAG_CHECK(e->flags, EMITTER_FLAG_DISABLED) && e->particles.count > 0) // don't draw when disabled
+    if(e->particles.sort_max < e->particles.max) 
     {
-        BeginBlendMode(e->mode);
-        int start = 0, end = e->particles.max, step = 1;
-        if(FLAG_CHECK(e->flags, EMITTER_FLAG_REVERSE_DRAW_ORDER)) 
-        { 
-            // drawn particles in reverse order
-            start = e->particles.max - 1;
-            end = -1;
-            step = -1;
+        // the old content is rebuilt below so there is nothing to keep
+        EmitterFreeSortArrays(e);
+        const size_t n = (size_t)e->particles.max;
+        e->particles.sort_key = (unsigned short*)malloc(2*n*sizeof(unsigned short));
+        e->particles.order = (unsigned int*)malloc(2*n*sizeof(unsigned int));
+        if(e->particles.sort_key == NULL || e->particles.order == NULL) {
+            EmitterFreeSortArrays(e);
+            return false;
+        }
+        e->particles.sort_max = e->particles.max;
+    }
+    
+    const int n = e->particles.count;
+    unsigned short* key = e->particles.sort_key;
+    unsigned short* tmp_key = key + e->particles.sort_max;
+    unsigned int* order = e->particles.order;
+    unsigned int* tmp_order = order + e->particles.sort_max;
+    const float age = fmaxf(e->config.age.min, e->config.age.max);
+    
+    switch(e->config.sort) 
+    {
+        case EMITTER_SORT_SPAWN_TIME: // oldest first
+            for(int i=0; i<n; ++i) key[i] = 65535 - ParticleSortKey(e->particles.time[i], age);
+            break;
+        case EMITTER_SORT_REMAINING_LIFE: // closest to dying first
+            for(int i=0; i<n; ++i) key[i] = ParticleSortKey(ParticleLife(e, i) - e->particles.time[i], age);
+            break;
+        case EMITTER_SORT_DEPTH: // smallest y first
+            for(int i=0; i<n; ++i) key[i] = ParticleSortKey(ParticleDrawPosition(e, i, params).y - e->bounds_min.y, e->bounds_max.y - e->bounds_min.y);
+            break;
+        default:
+            for(int i=0; i<n; ++i) order[i] = i;
+            return true;
+    }
+    
+    // low byte (the particles start in storage order)
+    unsigned int offset[256] = {0};
+    for(int i=0; i<n; ++i) offset[key[i] & 0xFF]++;
+    for(unsigned int b=0, sum=0; b<256; ++b) { const unsigned int c = offset[b]; offset[b] = sum; sum += c; }
+    for(int i=0; i<n; ++i) {
+        const unsigned int dst = offset[key[i] & 0xFF]++;
+        tmp_key[dst] = key[i];
+        tmp_order[dst] = i;
+    }
+    
+    // high byte
+    memset(offset, 0, sizeof(offset));
+    for(int i=0; i<n; ++i) offset[tmp_key[i] >> 8]++;
+    for(unsigned int b=0, sum=0; b<256; ++b) { const unsigned int c = offset[b]; offset[b] = sum; sum += c; }
+    for(int i=0; i<n; ++i) order[offset[tmp_key[i] >> 8]++] = tmp_order[i];
+    return true;
+}
+
+Rectangle EmitterGetBounds(Emitter* e) {
+    if(e->particles.count == 0 || e->bounds_min.x > e->bounds_max.x) return (Rectangle){0};
+    EmitterBakeEasing(e);
+    
+    // biggest half size a particle can have (the easing can overshoot the scale range)
+    const float scale = fmaxf(fabsf(e->config.scale.start + (e->config.scale.end - e->config.scale.start)*e->easing_min), 
+        fabsf(e->config.scale.start + (e->config.scale.end - e->config.scale.start)*e->easing_max));
+    const float size = fmaxf(fabsf(e->config.size.min), fabsf(e->config.size.max))*scale;
+    float hw = size/2, hh = size/2;
+    if(e->config.atlas.texture.id != 0) {
+        hw = (float)e->config.atlas.texture.width*size/2;
+        hh = (float)e->config.atlas.texture.height*size/2;
+        if(e->config.atlas.hframes*e->config.atlas.vframes > 1) {
+            hw /= e->config.atlas.hframes;
+            hh /= e->config.atlas.vframes;
+        }
+    }
+    const float r = sqrtf(hw*hw + hh*hh); // the particles can be rotated
+    
+    Vector2 min = e->bounds_min;
+    if(FLAG_CHECK(e->flags, EMITTER_FLAG_WORLD_SPACE)) min = Vector2Add(min, e->position);
+    return (Rectangle){ min.x - r, min.y - r, e->bounds_max.x - e->bounds_min.x + 2*r, e->bounds_max.y - e->bounds_min.y + 2*r };
+}
+
+int EmitterBuildVertices(Emitter* e, EmitterExtraParams* params, ParticleVertex* out, int capacity) 
+{
+    if(FLAG_CHECK(e->flags, EMITTER_FLAG_DISABLED)) return 0; // don't draw when disabled
+    EmitterBakeEasing(e);
+    EmitterBakeGradient(e);
+    
+    // cull the whole emitter first (if it's completely inside the screen area there is no need to cull the particles)
+    Rectangle* screen = params->screen;
+    if(screen != NULL) 
+    {
+        const Rectangle b = EmitterGetBounds(e);
+        if(b.x > screen->x + screen->width || b.x + b.width < screen->x || b.y > screen->y + screen->height || b.y + b.height < screen->y) {
+            params->next = e->particles.count;
+            return 0;
+        }
+        if(b.x >= screen->x && b.y >= screen->y && b.x + b.width <= screen->x + screen->width && b.y + b.height <= screen->y + screen->height) 
+            screen = NULL;
+    }
+    
+    bool sorted = EmitterNeedsSort(e);
+    if(sorted && params->next == 0) EmitterSortParticles(e, params); // sort once per frame (not for every batch)
+    sorted = sorted && e->particles.sort_max >= e->particles.count; // storage order when the sort arrays couldn't be allocated
+    
+    const bool reverse = FLAG_CHECK(e->flags, EMITTER_FLAG_REVERSE_DRAW_ORDER);
+    const bool textured = e->config.atlas.texture.id != 0;
+    const int frames = e->config.atlas.hframes*e->config.atlas.vframes;
+    int written = 0;
+    
+    // area of the texture in normalized coordinates (a part of the atlas page when it was packed)
+    Rectangle area = {0.0f, 0.0f, 1.0f, 1.0f};
+    if(textured && e->config.atlas.page.id != 0) {
+        const Rectangle src = e->config.atlas.source;
+        area = (Rectangle){ src.x/e->config.atlas.page.width, src.y/e->config.atlas.page.height, 
+            src.width/e->config.atlas.page.width, src.height/e->config.atlas.page.height };
+    }
+    
+    for(; params->next < e->particles.count && written + 4 <= capacity; params->next++) 
+    {
+        const int k = reverse ? e->particles.count - 1 - params->next : params->next;
+        const int i = sorted ? (int)e->particles.order[k] : k;
+        const float time = e->particles.time[i];
+        const float life = ParticleLife(e, i);
+        const float size = ParticleSize(e, i)*EmitterEase(e, time, e->config.scale.start, e->config.scale.end, life);
+        
+        Vector2 center = ParticleDrawPosition(e, i, params);
+        if(FLAG_CHECK(e->flags, EMITTER_FLAG_WORLD_SPACE)) center = Vector2Add(center, e->position);
+        
+        // half the size of the quad
+        float hw = size/2, hh = size/2;
+        if(textured) {
+            hw = (float)e->config.atlas.texture.width*size/2;
+            hh = (float)e->config.atlas.texture.height*size/2;
+            if(frames > 1) {
+                hw /= e->config.atlas.hframes;
+                hh /= e->config.atlas.vframes;
+            }
         }
         
-        if(e->config.atlas.texture.id != 0) 
+        if(screen != NULL) 
         {
-            // DRAW TEXTURED PARTICLES
-            for(int i=start; i!=end; i+=step)
-            {
-                Particle* p = &e->particles.data[i];
-                if(p->life != 0.0f)
-                {
-                    float size = p->size*e->config.easing(p->time, e->config.scale.start, e->config.scale.end - e->config.scale.start, p->life);
-                    
-                    float rotst = e->config.rotation.start;
-                    if(FLAG_CHECK(e->flags, EMITTER_FLAG_DIRECTIONAL_ROTATION))  rotst += p->angle;
-                    float rotation = e->config.easing(p->time, rotst, e->config.rotation.end - e->config.scale.start, p->life);
-                    
-                    Vector2 center = p->position;
-                    if(FLAG_CHECK(e->flags, EMITTER_FLAG_WORLD_SPACE)) center = Vector2Add(center, e->position);
-                    
-                    float w = (float)e->config.atlas.texture.width*size;
-                    float h = (float)e->config.atlas.texture.height*size;
-                    if(e->config.atlas.hframes*e->config.atlas.vframes > 1) {
-                        w = (float)e->config.atlas.texture.width/e->config.atlas.hframes*size;
-                        h = (float)e->config.atlas.texture.height/e->config.atlas.vframes*size;
-                    }
-                    Vector2 vertex[4] = { (Vector2){center.x-w/2, center.y-h/2}, 
-                            (Vector2){center.x+w/2, center.y-h/2},
-                            (Vector2){center.x+w/2, center.y+h/2}, 
-                            (Vector2){center.x-w/2, center.y+h/2}, 
-                    };
-                        
-                    if(rotation != 0.0f) { 
-                        // rotate the vertices of the quad that holds the texture
-                        vertex[0] = RotatePointOnCircle(center, vertex[0], rotation);
-                        vertex[1] = RotatePointOnCircle(center, vertex[1], rotation);
-                        vertex[2] = RotatePointOnCircle(center, vertex[2], rotation);
-                        vertex[3] = RotatePointOnCircle(center, vertex[3], rotation);
-                    }
-                    
-                    int inside = true;
-                    if(params->screen != NULL) 
-                    {
-                        // check rotated points to see if at least one is inside the screen area
-                        inside = CheckCollisionPointRec(vertex[0], *params->screen) | CheckCollisionPointRec(vertex[1], *params->screen) |
-                            CheckCollisionPointRec(vertex[2], *params->screen) | CheckCollisionPointRec(vertex[3], *params->screen);
-                    }
-                    
-                    if(inside) 
-                    {
-                        // Get current color by interpolating
-                        Color color = Interpolate(e, p);
-                        
-                        if(e->config.atlas.hframes*e->config.atlas.vframes <= 1)
-                        {
-                            // DRAW STATIC TEXTURE
-                            DrawTexturePro(e->config.atlas.texture, (Rectangle){0.0f, 0.0f, e->config.atlas.texture.width, e->config.atlas.texture.height}, 
-                                (Rectangle){vertex[0].x, vertex[0].y, w, h}, (Vector2){0.0f, 0.0f}, rotation, color);
-                        }
-                        else 
-                        {
-                            // DRAW ANIMATED TEXTURE OR MULTITEXTURED PARTICLES
-                            int frame = p->tidx; // set multitexture index
-                            if(!FLAG_CHECK(e->flags, EMITTER_FLAG_MULTITEXTURE)) {
-                                // This is a animated texture so get the current frame of animation
-                                frame = e->config.easing(p->time, 0, e->config.atlas.vframes*e->config.atlas.hframes*e->config.atlas.loop-1, p->life);
-                                frame = Clamp(frame, 0.0f, e->config.atlas.vframes*e->config.atlas.hframes*e->config.atlas.loop-1);    
-                            }
-                            
-                            Rectangle src = {0.0f, 0.0f, 
-                                (float)e->config.atlas.texture.width/e->config.atlas.hframes, 
-                                (float)e->config.atlas.texture.height/e->config.atlas.vframes
-                            };
-                            
-                            src.x = (frame%e->config.atlas.hframes)*src.width;
-                            src.y = ((int)floorf(frame/e->config.atlas.hframes)%e->config.atlas.vframes)*src.height;
-                            DrawTexturePro(e->config.atlas.texture, src, (Rectangle){vertex[0].x, vertex[0].y, w, h}, (Vector2){0.0f, 0.0f}, rotation, color);
-                        }
-                        params->pixels += w*h;
-                        params->drawn++;
-                    }
-                    /* draw bounding box
-                    DrawLineEx(vertex[0], vertex[1], 2.0f, RED);
-                    DrawLineEx(vertex[1], vertex[2], 2.0f, RED);
-                    DrawLineEx(vertex[2], vertex[3], 2.0f, RED);
-                    DrawLineEx(vertex[3], vertex[0], 2.0f, RED);
-                     */
+            // skip particles with the bounding circle outside the screen area before doing any other work
+            const float r = sqrtf(hw*hw + hh*hh);
+            if(center.x + r < screen->x || center.x - r > screen->x + screen->width || 
+                center.y + r < screen->y || center.y - r > screen->y + screen->height) continue;
+        }
+        
+        Vector2 corner[4]; // corners relative to the center (clockwise from the top left)
+        Rectangle uv = {0.0f, 0.0f, 1.0f, 1.0f};
+        float rotation = 0.0f;
+        unsigned long long pixels = 0;
+        
+        if(textured) 
+        {
+            float rotst = e->config.rotation.start;
+            if(FLAG_CHECK(e->flags, EMITTER_FLAG_DIRECTIONAL_ROTATION))  rotst += ParticleAngle(e, i);
+            rotation = EmitterEase(e, time, rotst, rotst + e->config.rotation.end - e->config.rotation.start, life);
+            
+            if(frames > 1) {
+                // ANIMATED TEXTURE OR MULTITEXTURED PARTICLES
+                int frame = ParticleTextureIndex(e, i); // set multitexture index
+                if(!FLAG_CHECK(e->flags, EMITTER_FLAG_MULTITEXTURE)) {
+                    // This is a animated texture so get the current frame of animation
+                    frame = EmitterEase(e, time, 0, frames*e->config.atlas.loop-1, life);
+                    frame = Clamp(frame, 0.0f, frames*e->config.atlas.loop-1);    
                 }
+                
+                // frame region in normalized texture coordinates
+                uv.width = 1.0f/e->config.atlas.hframes;
+                uv.height = 1.0f/e->config.atlas.vframes;
+                uv.x = (frame%e->config.atlas.hframes)*uv.width;
+                uv.y = ((int)floorf(frame/e->config.atlas.hframes)%e->config.atlas.vframes)*uv.height;
             }
-        } 
+            uv = (Rectangle){ area.x + uv.x*area.width, area.y + uv.y*area.height, uv.width*area.width, uv.height*area.height };
+            
+            corner[0] = (Vector2){-hw, -hh};
+            corner[1] = (Vector2){hw, -hh};
+            corner[2] = (Vector2){hw, hh};
+            corner[3] = (Vector2){-hw, hh};
+            pixels = 4*hw*hh;
+        }
         else 
         {
-            // DRAW UNTEXTURED PARTICLES
-            for(int i=start; i!=end; i+=step)
+            rotation = EmitterEase(e, time, e->config.rotation.start, e->config.rotation.end, life);
+            if(!FLAG_CHECK(e->flags, EMITTER_FLAG_DRAW_TRIANGLES)) 
             {
-                Particle* p = &e->particles.data[i];
-                
-                if(p->life != 0.0f)
-                {
-                    float size = p->size*e->config.easing(p->time, e->config.scale.start, e->config.scale.end - e->config.scale.start, p->life);
-                    float rotation = e->config.easing(p->time, e->config.rotation.start, e->config.rotation.end - e->config.rotation.start, p->life);
-                    Color color = Interpolate(e, p);
-                    
-                    Vector2 center = p->position;
-                    if(FLAG_CHECK(e->flags, EMITTER_FLAG_WORLD_SPACE)) center = Vector2Add(center, e->position);
-                    
-                    if(!FLAG_CHECK(e->flags, EMITTER_FLAG_DRAW_TRIANGLES)) 
-                    {
-                        // DRAW SQUARES
-                        Vector2 point[5] = { (Vector2){center.x-size/2, center.y-size/2}, 
-                            (Vector2){center.x+size/2, center.y-size/2}, 
-                            (Vector2){center.x+size/2, center.y+size/2}, 
-                            (Vector2){center.x-size/2, center.y+size/2}, 
-                            (Vector2){center.x-size/2, center.y-size/2}
-                        };
-                        
-                        if(rotation != 0.0f) { 
-                            // rotate the points of the rectangle
-                            point[0] = RotatePointOnCircle(center, point[0], rotation);
-                            point[1] = RotatePointOnCircle(center, point[1], rotation);
-                            point[2] = RotatePointOnCircle(center, point[2], rotation);
-                            point[3] = RotatePointOnCircle(center, point[3], rotation);
-                            point[4] = point[0]; // the rect has only 4 points, the 5th point is just used by DrawLineStrip()
-                        }
-                        
-                        int inside = true;
-                        
-                        if(params->screen != NULL) {
-                            // check rotated points to see if at least one is inside the screen area
-                            inside = CheckCollisionPointRec(point[0], *params->screen) | CheckCollisionPointRec(point[1], *params->screen) |
-                                CheckCollisionPointRec(point[2], *params->screen) | CheckCollisionPointRec(point[3], *params->screen);
-                        }
-                        
-                        if(inside) 
-                        {
-                            if(!FLAG_CHECK(e->flags, EMITTER_FLAG_DRAW_OUTLINE)) {
-                                DrawRectanglePro((Rectangle){point[0].x, point[0].y, size, size}, (Vector2){0.0f, 0.0f}, rotation, color);
-                                params->pixels += size*size;
-                            }
-                            else {
-                                DrawLineStrip((Vector2*)&point, 5, color);
-                                params->pixels += 2*(size+size);
-                            }
-                            params->drawn++;
-                        }
-                    } 
-                    else 
-                    {
-                        // DRAW TRIANGLES
-                        Vector2 point[4] = {(Vector2){center.x, center.y-size/2}, 
-                            (Vector2){center.x+size/2, center.y+size/2}, 
-                            (Vector2){center.x-size/2, center.y+size/2},
-                            (Vector2){center.x, center.y-size/2},
-                        };
-                        
-                        if(rotation != 0.0f) { 
-                            // rotate the points of the rectangle
-                            point[0] = RotatePointOnCircle(center, point[0], rotation);
-                            point[1] = RotatePointOnCircle(center, point[1], rotation);
-                            point[2] = RotatePointOnCircle(center, point[2], rotation);
-                            point[3] = point[0]; // the triangle has only 3 points, the 4th point is just used by DrawLineStrip()
-                        }
-                        
-                        int inside = true;
-                        if(params->screen != NULL) {
-                            // check rotated points to see if at least one is inside the screen area
-                            inside = CheckCollisionPointRec(point[0], *params->screen) | CheckCollisionPointRec(point[1], *params->screen) |
-                                CheckCollisionPointRec(point[2], *params->screen);
-                        }
-                        
-                        if(inside) {
-                            if(!FLAG_CHECK(e->flags, EMITTER_FLAG_DRAW_OUTLINE)) {
-                                DrawTriangle(point[0], point[2], point[1], color);
-                                params->pixels += (size*size*sqrtf(3))/4;
-                            }
-                            else {
-                                DrawLineStrip((Vector2*)&point, 4, color);
-                                params->pixels += 3*size;
-                            }
-                            
-                            params->drawn++;
-                        }
-                        
-                    }
+                // SQUARES
+                corner[0] = (Vector2){-hw, -hh};
+                corner[1] = (Vector2){hw, -hh};
+                corner[2] = (Vector2){hw, hh};
+                corner[3] = (Vector2){-hw, hh};
+                pixels = FLAG_CHECK(e->flags, EMITTER_FLAG_DRAW_OUTLINE) ? 2*(size+size) : size*size;
+            }
+            else 
+            {
+                // TRIANGLES (a quad with the 2 right corners in the same place)
+                corner[0] = (Vector2){0.0f, -hh};
+                corner[1] = (Vector2){hw, hh};
+                corner[2] = corner[1];
+                corner[3] = (Vector2){-hw, hh};
+                pixels = FLAG_CHECK(e->flags, EMITTER_FLAG_DRAW_OUTLINE) ? 3*size : (size*size*sqrtf(3))/4;
+            }
+        }
+        
+        // rotate the corners of the quad around the center (all of them use the same sin/cos)
+        Vector2 vertex[4];
+        float s = 0.0f, c = 1.0f;
+        if(rotation != 0.0f) {
+            s = sinf(rotation*DEG2RAD);
+            c = cosf(rotation*DEG2RAD);
+        }
+        for(int k=0; k<4; ++k) 
+            vertex[k] = (Vector2){center.x + corner[k].x*c - corner[k].y*s, center.y + corner[k].x*s + corner[k].y*c};
+        
+        if(screen != NULL) 
+        {
+            // check rotated points to see if at least one is inside the screen area
+            const bool inside = ParticlePointInRect(vertex[0], *screen) | ParticlePointInRect(vertex[1], *screen) |
+                ParticlePointInRect(vertex[2], *screen) | ParticlePointInRect(vertex[3], *screen);
+            if(!inside) continue;
+        }
+        
+        // Get current color by interpolating
+        ParticleWriteQuad(&out[written], vertex, uv, Interpolate(e, i));
+        written += 4;
+        params->pixels += pixels;
+        params->drawn++;
+    }
+    
+    return written;
+}
+
+void EmitterDraw(Emitter* e, EmitterExtraParams* params) 
+{
+    // NOTE: the vertices are built in small batches and written straight into the rlgl batch with one texture bind 
+    // and one blend mode per emitter
+    if(!FLAG_CHECK(e->flags, EMITTER_FLAG_DISABLED) && e->particles.count > 0) // don't draw when disabled
+    {
+        unsigned int texture = rlGetTextureIdDefault();
+        if(e->config.atlas.texture.id != 0) texture = (e->config.atlas.page.id != 0) ? e->config.atlas.page.id : e->config.atlas.texture.id;
+        const bool outline = e->config.atlas.texture.id == 0 && FLAG_CHECK(e->flags, EMITTER_FLAG_DRAW_OUTLINE);
+        ParticleVertex vertices[4*PARTICLES_DRAW_BATCH];
+        
+        BeginBlendMode(e->mode);
+        params->next = 0;
+        int n = 0;
+        while((n = EmitterBuildVertices(e, params, vertices, 4*PARTICLES_DRAW_BATCH)) > 0) 
+        {
+            if(outline) 
+            {
+                // outlines are lines so they don't go through the quad batch
+                for(int q=0; q<n; q+=4) {
+                    Vector2 point[5] = { {vertices[q].x, vertices[q].y}, {vertices[q+1].x, vertices[q+1].y}, {vertices[q+2].x, vertices[q+2].y}, 
+                        {vertices[q+3].x, vertices[q+3].y}, {vertices[q].x, vertices[q].y} };
+                    DrawLineStrip(point, 5, vertices[q].color);
                 }
+                continue;
+            }
+            
+            rlCheckRenderBatchLimit(n); // flush first if all the vertices don't fit
+            rlSetTexture(texture);
+            rlBegin(RL_QUADS);
+            for(int q=0; q<n; q+=4) {
+                // rlgl wants the corners counter clockwise from the top left
+                const ParticleVertex* v = &vertices[q];
+                rlColor4ub(v[0].color.r, v[0].color.g, v[0].color.b, v[0].color.a);
+                rlTexCoord2f(v[0].u, v[0].v); rlVertex2f(v[0].x, v[0].y);
+                rlTexCoord2f(v[3].u, v[3].v); rlVertex2f(v[3].x, v[3].y);
+                rlTexCoord2f(v[2].u, v[2].v); rlVertex2f(v[2].x, v[2].y);
+                rlTexCoord2f(v[1].u, v[1].v); rlVertex2f(v[1].x, v[1].y);
+            }
+            rlEnd();
+        }
+        rlSetTexture(0);
+        if(!params->keep_blend_mode) EndBlendMode();
+    }
+}
+
+// A texture to pack and where it goes
+typedef struct {
+    Texture2D texture;
+    int page;               // -1 when it doesn't fit
+    Rectangle source;
+} ParticleAtlasItem;
+
+static int ParticleAtlasCompare(const void* a, const void* b) {
+    // tallest first so the shelves waste less space
+    return ((const ParticleAtlasItem*)b)->texture.height - ((const ParticleAtlasItem*)a)->texture.height;
+}
+
+int ParticlesPackAtlas(Emitter** emitters, int count, int size, Texture2D* pages, int max_pages) {
+    ParticleAtlasItem* items = calloc(count > 0 ? count : 1, sizeof(ParticleAtlasItem));
+    if(items == NULL) return 0;
+    
+    // every texture once
+    int n = 0;
+    for(int i=0; i<count; ++i) {
+        emitters[i]->config.atlas.page = (Texture2D){0};
+        const Texture2D t = emitters[i]->config.atlas.texture;
+        if(t.id == 0) continue;
+        int k = 0;
+        while(k < n && items[k].texture.id != t.id) ++k;
+        if(k == n) items[n++] = (ParticleAtlasItem){ .texture = t, .page = -1 };
+    }
+    qsort(items, n, sizeof(ParticleAtlasItem), ParticleAtlasCompare);
+    
+    // place them on shelves, opening a new page when the current one is full
+    const int pad = PARTICLES_ATLAS_PADDING;
+    int page = 0, x = 0, y = 0, shelf = 0;
+    for(int k=0; k<n && page<max_pages; ++k) {
+        const int w = items[k].texture.width + 2*pad, h = items[k].texture.height + 2*pad;
+        if(w > size || h > size) continue; // too big for any page
+        if(x + w > size) { x = 0; y += shelf; shelf = 0; }
+        if(y + h > size) {
+            if(++page == max_pages) break;
+            x = y = shelf = 0;
+        }
+        items[k].page = page;
+        items[k].source = (Rectangle){ x + pad, y + pad, items[k].texture.width, items[k].texture.height };
+        x += w;
+        if(h > shelf) shelf = h;
+    }
+    const int page_count = (page < max_pages && (x > 0 || y > 0)) ? page + 1 : page;
+    
+    // copy the pixels of the textures to their pages
+    for(int p=0; p<page_count; ++p) {
+        Image image = GenImageColor(size, size, BLANK);
+        for(int k=0; k<n; ++k) {
+            if(items[k].page != p) continue;
+            Image src = GetTextureData(items[k].texture);
+            ImageFormat(&src, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+            for(int row=0; row<src.height; ++row) {
+                memcpy((Color*)image.data + ((int)items[k].source.y + row)*size + (int)items[k].source.x, 
+                    (Color*)src.data + row*src.width, src.width*sizeof(Color));
             }
+            UnloadImage(src);
         }
-        EndBlendMode();
+        pages[p] = LoadTextureFromImage(image);
+        UnloadImage(image);
+    }
+    
+    // point the emitters to the copies
+    for(int i=0; i<count; ++i) {
+        for(int k=0; k<n; ++k) {
+            if(items[k].texture.id != emitters[i]->config.atlas.texture.id || items[k].page == -1) continue;
+            emitters[i]->config.atlas.page = pages[items[k].page];
+            emitters[i]->config.atlas.source = items[k].source;
+            break;
+        }
+    }
+    free(items);
+    return page_count;
+}
+
+void ParticlesUnpackAtlas(Emitter** emitters, int count, Texture2D* pages, int page_count) {
+    for(int i=0; i<count; ++i) emitters[i]->config.atlas.page = (Texture2D){0};
+    for(int p=0; p<page_count; ++p) {
+        UnloadTexture(pages[p]);
+        pages[p] = (Texture2D){0};
     }
 }
 